@@ -0,0 +1,494 @@
+/*
+ * Benchmark suite for Heap
+ *
+ * heap_bench [--sizes 1e3,1e4,...] [--types int,string,struct64]
+ *            [--ops insert,pop,update,erase,heapify,toSortedVector,copy]
+ *            [--arity 2,4,8,16] [--warmup W] [--repetitions R]
+ *            [--output results.json]
+ *
+ * Every operation is run W times to warm up and R times measured without any
+ * instrumentation for the throughput. Insert, pop, update and erase do n
+ * single operations on a heap of n elements, they are run R more times with
+ * every operation timed on its own for the latency percentiles. The latencies
+ * go to a LatencyHistogram, which needs no memory per operation and knows
+ * them to within 1/16. They are read from the time stamp counter where there
+ * is one, and include the timer overhead, which is reported on its own.
+ * Heapify, toSortedVector and copy are one bulk operation over n elements and
+ * report the median time per element of the throughput runs only, R samples
+ * are too few for a p99.
+ *
+ * The table goes to stderr, the JSON to the --output file or to stdout.
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include "heap.h"
+#include "heaplatency.h"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+#if defined(__x86_64__) || defined(__i386__)
+using Ticks = TscTicks;
+#else
+using Ticks = SteadyTicks;
+#endif
+
+// Keeps results of bulk operations alive, so they are not optimized away.
+volatile size_t gSink = 0;
+
+// Element of 64 bytes ordered by its key.
+struct Payload64
+{
+    std::uint64_t mKey;
+    char mData[56];
+};
+
+bool operator>(const Payload64& lhs, const Payload64& rhs)
+{
+    return lhs.mKey > rhs.mKey;
+}
+
+template< typename T >
+struct ValueMaker;
+
+template<>
+struct ValueMaker< int >
+{
+    static const char* name() { return "int"; }
+
+    static int make(std::uint64_t x) { return static_cast<int>(x >> 33); }
+};
+
+template<>
+struct ValueMaker< std::string >
+{
+    static const char* name() { return "string"; }
+
+    // longer than the small string buffer, so every string allocates
+    static std::string make(std::uint64_t x) { return "key-" + std::to_string(x >> 20) + "-without-sso"; }
+};
+
+template<>
+struct ValueMaker< Payload64 >
+{
+    static const char* name() { return "struct64"; }
+
+    static Payload64 make(std::uint64_t x)
+    {
+        Payload64 payload;
+        payload.mKey = x;
+        std::memset(payload.mData, static_cast<int>(x & 0xff), sizeof(payload.mData));
+        return payload;
+    }
+};
+
+struct Config
+{
+    std::vector<size_t> mSizes = { 1000, 10000, 100000, 1000000 };
+    std::vector<std::string> mTypes = { "int", "string", "struct64" };
+    std::vector<std::string> mOps = { "insert", "pop", "update", "erase", "heapify", "toSortedVector", "copy" };
+    std::vector<size_t> mArities = { 2 };
+    size_t mWarmup = 1;
+    size_t mRepetitions = 5;
+    std::string mOutput;
+};
+
+struct Result
+{
+    std::string mType;
+    size_t mArity;
+    size_t mSize;
+    std::string mOp;
+    size_t mRepetitions;
+    double mMedianNs;
+    bool mHasP99;
+    double mP99Ns;
+    double mThroughput;
+};
+
+// Times the whole batch of operations in the throughput runs and records
+// the ticks of every single operation in the latency runs. The preparation
+// of the heap around the batch is never timed.
+class Timer
+{
+private:
+    LatencyHistogram* mLatencies;
+    double mBatchNs = 0;
+
+public:
+    // A throughput timer without latencies, or a latency timer.
+    explicit Timer(LatencyHistogram* latencies = nullptr)
+        :mLatencies(latencies) { }
+
+    template< typename Fn >
+    void batch(Fn fn)
+    {
+        if(mLatencies != nullptr) { fn(); return; }
+
+        auto start = Clock::now();
+        fn();
+        mBatchNs += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    template< typename Fn >
+    void operator()(Fn fn)
+    {
+        if(mLatencies == nullptr) { fn(); return; }
+
+        std::uint64_t start = Ticks::now();
+        fn();
+        mLatencies->record(Ticks::now() - start);
+    }
+
+    double getBatchNs() const
+    {
+        return mBatchNs;
+    }
+};
+
+// Nanoseconds per tick, measured against the steady clock.
+double measureTickNs()
+{
+    auto start = Clock::now();
+    std::uint64_t startTicks = Ticks::now();
+    auto end = start;
+
+    while(end - start < std::chrono::milliseconds(50)) { end = Clock::now(); }
+
+    std::uint64_t ticks = Ticks::now() - startTicks;
+    return std::chrono::duration<double, std::nano>(end - start).count() / std::max<std::uint64_t>(1, ticks);
+}
+
+// The median ticks of an empty timed section, which every latency includes.
+double measureTimerOverhead()
+{
+    LatencyHistogram latencies;
+    Timer timer(&latencies);
+
+    for(int i = 0; i < 10000; ++i)
+    {
+        timer([] { });
+    }
+
+    return static_cast<double>(latencies.getPercentile(0.5));
+}
+
+double getPercentile(std::vector<double>& samples, double percentile)
+{
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(samples.size() * percentile));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+template< typename T, size_t Arity >
+class Suite
+{
+private:
+    using HeapType = Heap< T, std::greater< T >, Arity >;
+    using Handle = typename HeapType::Handle;
+
+    std::vector<T> mValues;
+    std::vector<T> mUpdates;
+    std::vector<size_t> mOrder;
+
+    // Prepares the heap for the operation, then runs it with the timer.
+    // Returns the number of operations, or the number of elements for the
+    // bulk operations.
+    size_t runOnce(const std::string& op, Timer& timer) const
+    {
+        size_t n = mValues.size();
+
+        if(op == "insert")
+        {
+            HeapType heap;
+            timer.batch([&]
+            {
+                for(const auto& value : mValues) { timer([&] { heap.insert(value); }); }
+            });
+            return n;
+        }
+
+        if(op == "heapify")
+        {
+            timer.batch([&]
+            {
+                timer([&] { gSink = gSink + HeapType(mValues.begin(), mValues.end()).size(); });
+            });
+            return n;
+        }
+
+        HeapType heap;
+        std::vector<Handle> handles;
+        handles.reserve(n);
+        for(const auto& value : mValues) { handles.push_back(heap.insert(value)); }
+
+        timer.batch([&]
+        {
+            if(op == "pop")
+            {
+                for(size_t i = 0; i < n; ++i) { timer([&] { heap.pop(); }); }
+            }
+            else if(op == "update")
+            {
+                for(size_t i = 0; i < n; ++i) { timer([&] { heap.update(handles[i], mUpdates[i]); }); }
+            }
+            else if(op == "erase")
+            {
+                for(size_t i : mOrder) { timer([&] { heap.erase(handles[i]); }); }
+            }
+            else if(op == "toSortedVector")
+            {
+                timer([&] { gSink = gSink + toSortedVector(heap).size(); });
+            }
+            else if(op == "copy")
+            {
+                timer([&] { gSink = gSink + HeapType(heap).size(); });
+            }
+        });
+
+        return n;
+    }
+
+public:
+    explicit Suite(size_t size)
+    {
+        std::mt19937_64 randgen(size);
+
+        for(size_t i = 0; i < size; ++i)
+        {
+            mValues.push_back(ValueMaker<T>::make(randgen()));
+            mUpdates.push_back(ValueMaker<T>::make(randgen()));
+            mOrder.push_back(i);
+        }
+
+        std::shuffle(mOrder.begin(), mOrder.end(), randgen);
+    }
+
+    Result run(const std::string& op, const Config& config, double tickNs) const
+    {
+        bool bulk = op == "heapify" || op == "toSortedVector" || op == "copy";
+        Timer throughput;
+        size_t count = 0;
+
+        for(size_t i = 0; i < config.mWarmup; ++i)
+        {
+            Timer warmup;
+            runOnce(op, warmup);
+        }
+
+        // bulk operations are timed as a whole and divided per element
+        std::vector<double> bulkSamples;
+
+        for(size_t i = 0; i < config.mRepetitions; ++i)
+        {
+            double startNs = throughput.getBatchNs();
+            size_t n = runOnce(op, throughput);
+
+            count += n;
+            bulkSamples.push_back((throughput.getBatchNs() - startNs) / n);
+        }
+
+        Result result;
+        result.mType = ValueMaker<T>::name();
+        result.mArity = Arity;
+        result.mSize = mValues.size();
+        result.mOp = op;
+        result.mRepetitions = config.mRepetitions;
+        result.mHasP99 = !bulk;
+        result.mThroughput = count / (throughput.getBatchNs() * 1e-9);
+
+        if(bulk)
+        {
+            result.mMedianNs = getPercentile(bulkSamples, 0.5);
+            result.mP99Ns = 0;
+            return result;
+        }
+
+        LatencyHistogram latencies;
+
+        for(size_t i = 0; i < config.mRepetitions; ++i)
+        {
+            Timer latency(&latencies);
+            runOnce(op, latency);
+        }
+
+        result.mMedianNs = latencies.getPercentile(0.5) * tickNs;
+        result.mP99Ns = latencies.getPercentile(0.99) * tickNs;
+        return result;
+    }
+};
+
+template< typename T, size_t Arity >
+void runType(const Config& config, double tickNs, std::vector<Result>& results)
+{
+    for(size_t size : config.mSizes)
+    {
+        Suite<T, Arity> suite(size);
+
+        for(const auto& op : config.mOps)
+        {
+            results.push_back(suite.run(op, config, tickNs));
+
+            const Result& r = results.back();
+            std::cerr << r.mType << "\t" << r.mArity << "-ary\t" << r.mSize << "\t" << r.mOp
+                      << "\tmedian " << r.mMedianNs << " ns\tp99 ";
+            if(r.mHasP99) { std::cerr << r.mP99Ns << " ns\t"; }
+            else { std::cerr << "-\t"; }
+            std::cerr << r.mThroughput << " ops/s" << std::endl;
+        }
+    }
+}
+
+template< size_t Arity >
+void runArity(const Config& config, double tickNs, std::vector<Result>& results)
+{
+    for(const auto& type : config.mTypes)
+    {
+        if(type == "int") { runType<int, Arity>(config, tickNs, results); }
+        else if(type == "string") { runType<std::string, Arity>(config, tickNs, results); }
+        else if(type == "struct64") { runType<Payload64, Arity>(config, tickNs, results); }
+        else { std::cerr << "unknown type " << type << std::endl; }
+    }
+}
+
+void writeJson(std::ostream& out, const Config& config, double overheadNs, const std::vector<Result>& results)
+{
+    out << "{\n  \"warmup\": " << config.mWarmup << ",\n  \"timer_overhead_ns\": " << overheadNs
+        << ",\n  \"benchmarks\": [";
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    { \"type\": \"" << r.mType << "\", \"arity\": " << r.mArity
+            << ", \"size\": " << r.mSize << ", \"operation\": \"" << r.mOp
+            << "\", \"repetitions\": " << r.mRepetitions
+            << ", \"median_ns\": " << r.mMedianNs;
+        if(r.mHasP99) { out << ", \"p99_ns\": " << r.mP99Ns; }
+        out << ", \"throughput_per_s\": " << r.mThroughput << " }";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+
+    while(std::getline(stream, item, ','))
+    {
+        if(!item.empty()) { items.push_back(item); }
+    }
+
+    return items;
+}
+
+// Sizes may be written as 1e6.
+std::vector<size_t> parseSizes(const std::string& list)
+{
+    std::vector<size_t> sizes;
+
+    for(const auto& item : splitList(list))
+    {
+        sizes.push_back(static_cast<size_t>(std::stod(item)));
+    }
+
+    return sizes;
+}
+
+// Returns false on unknown options and on values that are not numbers.
+bool parseArgs(int argc, char** argv, Config& config)
+{
+    try
+    {
+        for(int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string option = argv[i];
+            std::string value = argv[i + 1];
+
+            if(option == "--sizes") { config.mSizes = parseSizes(value); }
+            else if(option == "--types") { config.mTypes = splitList(value); }
+            else if(option == "--ops") { config.mOps = splitList(value); }
+            else if(option == "--arity") { config.mArities = parseSizes(value); }
+            else if(option == "--warmup") { config.mWarmup = std::stoul(value); }
+            else if(option == "--repetitions") { config.mRepetitions = std::max<size_t>(1, std::stoul(value)); }
+            else if(option == "--output") { config.mOutput = value; }
+            else { return false; }
+        }
+    }
+    catch(const std::logic_error&)
+    {
+        // std::invalid_argument and std::out_of_range from stoul and stod
+        return false;
+    }
+
+    return argc % 2 == 1;
+}
+
+void printUsage(std::ostream& out, const char* program)
+{
+    out << "usage: " << program << " [--sizes 1e3,1e4,...] [--types int,string,struct64]"
+        << " [--ops insert,pop,update,erase,heapify,toSortedVector,copy] [--arity 2,4,8,16]"
+        << " [--warmup W] [--repetitions R] [--output results.json]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Config config;
+
+    if(argc == 2 && (std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0))
+    {
+        printUsage(std::cout, argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    if(!parseArgs(argc, argv, config))
+    {
+        printUsage(std::cerr, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double tickNs = measureTickNs();
+    double overheadNs = measureTimerOverhead() * tickNs;
+    std::vector<Result> results;
+
+    std::cerr << "timer overhead " << overheadNs << " ns, included in the latencies" << std::endl;
+
+    for(size_t arity : config.mArities)
+    {
+        if(arity == 2) { runArity<2>(config, tickNs, results); }
+        else if(arity == 4) { runArity<4>(config, tickNs, results); }
+        else if(arity == 8) { runArity<8>(config, tickNs, results); }
+        else if(arity == 16) { runArity<16>(config, tickNs, results); }
+        else { std::cerr << "unsupported arity " << arity << std::endl; }
+    }
+
+    if(config.mOutput.empty())
+    {
+        writeJson(std::cout, config, overheadNs, results);
+    }
+    else
+    {
+        std::ofstream out(config.mOutput);
+        writeJson(out, config, overheadNs, results);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+/*
+ * Bucket queue for small bounded integer priorities
+*/
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#ifndef CPP14_BUCKET_QUEUE
+#define CPP14_BUCKET_QUEUE
+
+/*
+Bucket queue (Dial's algorithm) of (priority, value) pairs with priorities in
+0..MaxPriority, ordered like PriorityQueue< unsigned, Value >, i.e. the highest
+priority is on the top. Every priority has its own bucket, a doubly linked
+list of the elements with that priority, and a bitmap of the non-empty buckets
+is scanned with count-trailing-zeros to find the top one. Insert, erase and
+update of the priority are O(1), top and pop are O(MaxPriority / 64). Elements
+with equal priority are served in insertion order.
+
+The list links live in the same slot table that backs the handles, which work
+the same way as the handles of Heap. The values are kept in a dense vector.
+ */
+template< typename Value, unsigned MaxPriority = 255 >
+class BucketQueue
+{
+public:
+    struct Handle;
+    using value_type = std::pair< unsigned, Value >;
+
+private:
+    using SlotId = std::uint32_t;
+    using Word = std::uint64_t;
+
+    static constexpr SlotId InvalidSlot = std::numeric_limits<SlotId>::max();
+    static constexpr size_t BucketCount = size_t(MaxPriority) + 1;
+    static constexpr size_t WordBits = std::numeric_limits<Word>::digits;
+    static constexpr size_t WordCount = (BucketCount + WordBits - 1) / WordBits;
+
+    // Handle table entry and list node. A live slot stores the position of
+    // its element in mValues, a free slot stores the next free slot.
+    struct Slot
+    {
+        SlotId mPos;
+        std::uint32_t mGeneration;
+        SlotId mPrev;
+        SlotId mNext;
+    };
+
+    std::vector<std::pair<value_type, SlotId>> mValues;
+    std::vector<Slot> mSlots;
+    SlotId mFreeSlot = InvalidSlot;
+    SlotId mHeads[BucketCount];
+    SlotId mTails[BucketCount];
+    // bit b is set if the bucket of priority MaxPriority - b is not empty, so
+    // the lowest set bit is the top bucket
+    Word mBitmap[WordCount];
+
+    static void checkPriority(unsigned priority)
+    {
+        if(priority > MaxPriority)
+        {
+            throw std::out_of_range("BucketQueue: priority out of range");
+        }
+    }
+
+    static size_t getBitOf(unsigned priority)
+    {
+        return MaxPriority - priority;
+    }
+
+    static size_t countTrailingZeros(Word word)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctzll(word);
+#else
+        size_t count = 0;
+        for(; (word & 1) == 0; word >>= 1) { ++count; }
+        return count;
+#endif
+    }
+
+    void reset()
+    {
+        for(size_t i = 0; i < BucketCount; ++i)
+        {
+            mHeads[i] = mTails[i] = InvalidSlot;
+        }
+
+        for(size_t i = 0; i < WordCount; ++i)
+        {
+            mBitmap[i] = 0;
+        }
+    }
+
+    SlotId acquireSlot(size_t pos)
+    {
+        SlotId slot = mFreeSlot;
+
+        if(slot != InvalidSlot)
+        {
+            mFreeSlot = mSlots[slot].mPos;
+        }
+        else
+        {
+            slot = static_cast<SlotId>(mSlots.size());
+            mSlots.push_back(Slot{ 0, 0, InvalidSlot, InvalidSlot });
+        }
+
+        mSlots[slot].mPos = static_cast<SlotId>(pos);
+        ++mSlots[slot].mGeneration;
+
+        return slot;
+    }
+
+    void releaseSlot(SlotId slot)
+    {
+        mSlots[slot].mPos = mFreeSlot;
+        ++mSlots[slot].mGeneration;
+        mFreeSlot = slot;
+    }
+
+    // Appends the slot to the list of the bucket of its element.
+    void link(SlotId slot)
+    {
+        unsigned priority = mValues[mSlots[slot].mPos].first.first;
+        SlotId tail = mTails[priority];
+
+        mSlots[slot].mPrev = tail;
+        mSlots[slot].mNext = InvalidSlot;
+
+        if(tail != InvalidSlot)
+        {
+            mSlots[tail].mNext = slot;
+        }
+        else
+        {
+            mHeads[priority] = slot;
+            size_t bit = getBitOf(priority);
+            mBitmap[bit / WordBits] |= Word(1) << (bit % WordBits);
+        }
+
+        mTails[priority] = slot;
+    }
+
+    void unlink(SlotId slot)
+    {
+        unsigned priority = mValues[mSlots[slot].mPos].first.first;
+        SlotId prev = mSlots[slot].mPrev;
+        SlotId next = mSlots[slot].mNext;
+
+        if(prev != InvalidSlot) { mSlots[prev].mNext = next; }
+        else { mHeads[priority] = next; }
+
+        if(next != InvalidSlot) { mSlots[next].mPrev = prev; }
+        else { mTails[priority] = prev; }
+
+        if(mHeads[priority] == InvalidSlot)
+        {
+            size_t bit = getBitOf(priority);
+            mBitmap[bit / WordBits] &= ~(Word(1) << (bit % WordBits));
+        }
+    }
+
+    SlotId getTopSlot() const
+    {
+        size_t word = 0;
+        while(mBitmap[word] == 0) { ++word; }
+
+        size_t bit = word * WordBits + countTrailingZeros(mBitmap[word]);
+        return mHeads[MaxPriority - bit];
+    }
+
+    void updateOp(const Handle& h, value_type&& value)
+    {
+        checkPriority(value.first);
+
+        unlink(h.mSlot);
+        mValues[mSlots[h.mSlot].mPos].first = std::move(value);
+        link(h.mSlot);
+    }
+
+public:
+    // Same requirements as Heap::Handle.
+    struct Handle
+    {
+    private:
+        SlotId mSlot = InvalidSlot;
+        std::uint32_t mGeneration = 0;
+
+        Handle(SlotId slot, std::uint32_t generation)
+            :mSlot(slot), mGeneration(generation) { }
+
+    public:
+        Handle() = default;
+
+        Handle(const Handle&) = default;
+
+        Handle(Handle&&) noexcept = default;
+
+        Handle& operator=(const Handle&) = default;
+
+        Handle& operator=(Handle&&) noexcept = default;
+
+        bool operator==(const Handle &o) const
+        {
+            return mSlot == o.mSlot && mGeneration == o.mGeneration;
+        }
+
+        bool operator!=(const Handle &o) const
+        {
+            return !(*this == o);
+        }
+
+        friend class BucketQueue;
+    };
+
+    // O(MaxPriority).
+    BucketQueue()
+    {
+        reset();
+    }
+
+    // O(n + MaxPriority). The handles from other should not be used with this.
+    BucketQueue( const BucketQueue & other ) = default;
+
+    // O(MaxPriority). All handles for other are valid handles for this.
+    BucketQueue( BucketQueue && other ) noexcept : BucketQueue()
+    {
+        swap(other);
+    }
+
+    // O(n + MaxPriority).
+    BucketQueue &operator=( BucketQueue other )
+    {
+        swap(other);
+        return *this;
+    }
+
+    // O(MaxPriority). After the swap all handles for this are valid handles
+    // for other and vice versa.
+    void swap( BucketQueue &other )
+    {
+        using std::swap;
+        swap(mValues, other.mValues);
+        swap(mSlots, other.mSlots);
+        swap(mFreeSlot, other.mFreeSlot);
+        swap(mHeads, other.mHeads);
+        swap(mTails, other.mTails);
+        swap(mBitmap, other.mBitmap);
+    }
+
+    // O(MaxPriority / 64). Get the element with the highest priority.
+    const value_type &top() const
+    {
+        return mValues[mSlots[getTopSlot()].mPos].first;
+    }
+
+    // O(MaxPriority / 64).
+    Handle topHandle() const
+    {
+        SlotId slot = getTopSlot();
+        return Handle(slot, mSlots[slot].mGeneration);
+    }
+
+    // O(MaxPriority / 64).
+    void pop()
+    {
+        if(!empty()) { erase(topHandle()); }
+    }
+
+    // O(1). Throws std::out_of_range if value.first is greater than
+    // MaxPriority, the queue is then left unchanged.
+    Handle insert( const value_type & value )
+    {
+        return insert(value_type(value));
+    }
+
+    // O(1). A version of insert which moves the element.
+    Handle insert( value_type && value )
+    {
+        checkPriority(value.first);
+
+        SlotId slot = acquireSlot(mValues.size());
+
+        try
+        {
+            mValues.emplace_back(std::move(value), slot);
+        }
+        catch(...)
+        {
+            releaseSlot(slot);
+            throw;
+        }
+
+        link(slot);
+        return Handle(slot, mSlots[slot].mGeneration);
+    }
+
+    // O(1). Precondition: h must be a valid handle for this.
+    const value_type &get( const Handle &h ) const
+    {
+        return mValues[mSlots[h.mSlot].mPos].first;
+    }
+
+    // O(1). Does the handle refer to an element of this queue?
+    bool contains( const Handle &h ) const
+    {
+        return h.mSlot < mSlots.size() && mSlots[h.mSlot].mGeneration == h.mGeneration;
+    }
+
+    // O(1). Update the element represented by the given handle, in either
+    // direction. The element goes to the back of its new bucket. Throws
+    // std::out_of_range like insert. Precondition: h must be a valid handle
+    // for this.
+    void update( const Handle &h, const value_type &value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, value_type(value));
+    }
+
+    // O(1). A version of update which moves the element.
+    void update( const Handle &h, value_type &&value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, std::move(value));
+    }
+
+    // O(1). Erase the element represented by the given handle.
+    void erase( const Handle &h )
+    {
+        if(empty()) { return; }
+
+        unlink(h.mSlot);
+
+        size_t pos = mSlots[h.mSlot].mPos;
+        if(pos + 1 != mValues.size())
+        {
+            mValues[pos] = std::move(mValues.back());
+            mSlots[mValues[pos].second].mPos = static_cast<SlotId>(pos);
+        }
+        mValues.pop_back();
+
+        releaseSlot(h.mSlot);
+    }
+
+    // O(1).
+    size_t size() const
+    {
+        return mValues.size();
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return mValues.empty();
+    }
+};
+
+// O(n MaxPriority / 64). Same as copySorted for Heap.
+template< typename OutputIterator, typename Value, unsigned MaxPriority >
+void copySorted( BucketQueue< Value, MaxPriority > queue, OutputIterator o )
+{
+    while(!queue.empty())
+    {
+        *o = queue.top();
+        ++o;
+        queue.pop();
+    }
+}
+
+// O(n MaxPriority / 64). Create sorted vector from the given queue.
+template< typename Value, unsigned MaxPriority >
+std::vector< std::pair< unsigned, Value > > toSortedVector( BucketQueue< Value, MaxPriority > queue )
+{
+    std::vector< std::pair< unsigned, Value > > result;
+    result.reserve(queue.size());
+    copySorted(std::move(queue), std::back_inserter(result));
+    return result;
+}
+
+// O(MaxPriority). Swaps two queues. See BucketQueue::swap for more.
+template< typename Value, unsigned MaxPriority >
+void swap( BucketQueue< Value, MaxPriority > & a, BucketQueue< Value, MaxPriority > & b ) { a.swap( b ); }
+
+#endif // CPP14_BUCKET_QUEUE
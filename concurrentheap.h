@@ -0,0 +1,638 @@
+/*
+ * Concurrent heap with fine-grained locking
+*/
+#include <functional> // less
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <new>
+#include "heap.h"
+
+#ifndef CPP14_CONCURRENT_HEAP
+#define CPP14_CONCURRENT_HEAP
+
+/*
+Thread-safe binary heap with a lock per node, along the lines of Hunt et al.,
+"An efficient algorithm for concurrent priority queue heaps" (1996), but with
+top-down insertion as in Rao and Kumar. Operations on different subtrees run in
+parallel, only reserving or releasing the last position takes the short global
+size lock.
+
+Locking protocol: node locks are always taken in increasing index order, i.e.
+parent before child and left child before right child, so there are no
+deadlocks. Insert reserves the next leaf, marks it pending and walks from the
+root to it hand-over-hand, leaving the better element in each node and
+carrying the worse one down. Pop takes the last element and, unless it is
+better than the root by then, swaps it with the root and sifts it down
+hand-over-hand. Update re-locks the parent and the node for
+every step up and re-validates that the element did not move meanwhile.
+Erase is serialized with the other size changes.
+
+Unlike Heap, the elements are not accessible by reference, as they can move at
+any time: top, pop and get copy or move the value out. Handles work the same
+way as the handles of Heap. The heap is neither copyable nor movable.
+ */
+template< typename T, typename Compare >
+class ConcurrentHeap : private CompareStorage< Compare >
+{
+    using CompareBase = CompareStorage< Compare >;
+
+public:
+    struct Handle;
+
+private:
+    using SlotId = std::uint32_t;
+
+    static constexpr SlotId InvalidSlot = std::numeric_limits<SlotId>::max();
+    static constexpr size_t NotFound = std::numeric_limits<size_t>::max();
+
+    static size_t getBitWidth(unsigned long long x)
+    {
+#if defined(__GNUC__)
+        return x == 0 ? 0 : std::numeric_limits<unsigned long long>::digits - __builtin_clzll(x);
+#else
+        size_t width = 0;
+        for(; x != 0; x >>= 1) { ++width; }
+        return width;
+#endif
+    }
+
+    // Array of blocks of doubling size, block k holding the indices from
+    // 2^k - 1 on. Blocks are never moved, so entries can be used while other
+    // threads add blocks. Adding blocks has to be synchronized by the caller.
+    template< typename Entry >
+    class SegmentedArray
+    {
+    private:
+        static constexpr size_t MaxBlocks = 40;
+
+        std::atomic<Entry*> mBlocks[MaxBlocks];
+
+        static size_t getBlockOf(size_t index)
+        {
+            return getBitWidth((index + 1) >> 1);
+        }
+
+    public:
+        SegmentedArray()
+        {
+            for(auto& block : mBlocks) { block.store(nullptr, std::memory_order_relaxed); }
+        }
+
+        SegmentedArray(const SegmentedArray&) = delete;
+
+        SegmentedArray& operator=(const SegmentedArray&) = delete;
+
+        ~SegmentedArray()
+        {
+            for(auto& block : mBlocks) { delete[] block.load(std::memory_order_relaxed); }
+        }
+
+        // Returns the entry, or nullptr if its block does not exist yet.
+        Entry* find(size_t index) const
+        {
+            size_t block = getBlockOf(index);
+            Entry* entries = mBlocks[block].load(std::memory_order_acquire);
+
+            return entries == nullptr ? nullptr : entries + (index + 1 - (size_t(1) << block));
+        }
+
+        // The block of index must exist.
+        Entry& operator[](size_t index) const
+        {
+            size_t block = getBlockOf(index);
+            return mBlocks[block].load(std::memory_order_acquire)[index + 1 - (size_t(1) << block)];
+        }
+
+        void ensure(size_t index)
+        {
+            size_t block = getBlockOf(index);
+
+            if(mBlocks[block].load(std::memory_order_relaxed) == nullptr)
+            {
+                mBlocks[block].store(new Entry[size_t(1) << block](), std::memory_order_release);
+            }
+        }
+
+        template< typename Fn >
+        void forEach(size_t count, Fn fn)
+        {
+            for(size_t i = 0; i < count; ++i) { fn((*this)[i]); }
+        }
+    };
+
+    enum class State { Empty, Pending, Full };
+
+    struct Node
+    {
+        std::mutex mLock;
+        State mState;
+        SlotId mSlot;
+        typename std::aligned_storage< sizeof(T), alignof(T) >::type mStorage;
+
+        T& value()
+        {
+            return *reinterpret_cast<T*>(&mStorage);
+        }
+    };
+
+    // Same as Heap::Slot, but the position and generation are read without
+    // holding any lock.
+    struct Slot
+    {
+        std::atomic<std::uint32_t> mPos;
+        std::atomic<std::uint32_t> mGeneration;
+        SlotId mNextFree;
+    };
+
+    using NodeLock = std::unique_lock<std::mutex>;
+
+    SegmentedArray<Node> mNodes;
+    SegmentedArray<Slot> mSlots;
+    std::mutex mSizeLock;
+    std::atomic<size_t> mSize { 0 };
+    std::mutex mSlotLock;
+    size_t mSlotCount = 0;
+    SlotId mFreeSlot = InvalidSlot;
+
+    bool compare(const T& lhs, const T& rhs)
+    {
+        return this->getCompare()(lhs, rhs);
+    }
+
+    SlotId acquireSlot()
+    {
+        std::lock_guard<std::mutex> guard(mSlotLock);
+        SlotId slot = mFreeSlot;
+
+        if(slot != InvalidSlot)
+        {
+            mFreeSlot = mSlots[slot].mNextFree;
+        }
+        else
+        {
+            slot = static_cast<SlotId>(mSlotCount++);
+            mSlots.ensure(slot);
+        }
+
+        mSlots[slot].mGeneration.fetch_add(1, std::memory_order_release);
+        return slot;
+    }
+
+    void releaseSlot(SlotId slot)
+    {
+        std::lock_guard<std::mutex> guard(mSlotLock);
+
+        mSlots[slot].mGeneration.fetch_add(1, std::memory_order_release);
+        mSlots[slot].mNextFree = mFreeSlot;
+        mFreeSlot = slot;
+    }
+
+    void setPos(SlotId slot, size_t pos)
+    {
+        mSlots[slot].mPos.store(static_cast<std::uint32_t>(pos), std::memory_order_release);
+    }
+
+    // Moves the value of a locked full node out and marks the node empty.
+    T takeValue(Node& node)
+    {
+        T result = std::move(node.value());
+        node.value().~T();
+        node.mState = State::Empty;
+        return result;
+    }
+
+    void putValue(Node& node, size_t index, T&& value, SlotId slot)
+    {
+        ::new (static_cast<void*>(&node.mStorage)) T(std::move(value));
+        node.mSlot = slot;
+        node.mState = State::Full;
+        setPos(slot, index);
+    }
+
+    void swapValues(Node& first, size_t firstIndex, Node& second, size_t secondIndex)
+    {
+        using std::swap;
+        swap(first.value(), second.value());
+        swap(first.mSlot, second.mSlot);
+        setPos(first.mSlot, firstIndex);
+        setPos(second.mSlot, secondIndex);
+    }
+
+    // Locks the child if it exists and holds a value. A pending child whose
+    // inserter has not reached it yet is skipped, the inserter compares its
+    // element with all the ancestors on the way.
+    NodeLock lockFullChild(size_t index)
+    {
+        Node* node = mNodes.find(index);
+        if(node == nullptr) { return NodeLock(); }
+
+        NodeLock lock(node->mLock);
+        if(node->mState != State::Full) { return NodeLock(); }
+
+        return lock;
+    }
+
+    // Sifts the element of the locked node down, locking hand-over-hand.
+    void siftDown(size_t index, NodeLock lock)
+    {
+        for(;;)
+        {
+            size_t left = 2 * index + 1;
+            NodeLock leftLock = lockFullChild(left);
+            NodeLock rightLock = lockFullChild(left + 1);
+
+            size_t child = left;
+            NodeLock* childLock = &leftLock;
+
+            if(!leftLock.owns_lock() ||
+               (rightLock.owns_lock() && compare(mNodes[left].value(), mNodes[left + 1].value())))
+            {
+                child = left + 1;
+                childLock = &rightLock;
+            }
+
+            if(!childLock->owns_lock() || !compare(mNodes[index].value(), mNodes[child].value()))
+            {
+                return;
+            }
+
+            swapValues(mNodes[index], index, mNodes[child], child);
+
+            lock = std::move(*childLock);
+            index = child;
+        }
+    }
+
+    // Sifts the element towards the root. Every step locks the parent and then
+    // the node, so the element may have moved meanwhile, in that case its new
+    // position is looked up again. The parent element swapped into the node is
+    // sifted down, as another child may have stopped its own sift up at the
+    // element before it moved up and be better than the parent element.
+    void siftUp(SlotId slot, std::uint32_t generation)
+    {
+        for(;;)
+        {
+            if(mSlots[slot].mGeneration.load(std::memory_order_acquire) != generation) { return; }
+
+            size_t index = mSlots[slot].mPos.load(std::memory_order_acquire);
+            if(index == 0) { return; }
+
+            size_t parent = (index - 1) / 2;
+            NodeLock parentLock(mNodes[parent].mLock);
+            NodeLock lock(mNodes[index].mLock);
+
+            Node& node = mNodes[index];
+            if(node.mState != State::Full || node.mSlot != slot)
+            {
+                lock.unlock();
+                parentLock.unlock();
+                std::this_thread::yield();
+                continue;
+            }
+
+            if(mNodes[parent].mState != State::Full ||
+               !compare(mNodes[parent].value(), node.value()))
+            {
+                return;
+            }
+
+            swapValues(mNodes[parent], parent, node, index);
+
+            parentLock.unlock();
+            siftDown(index, std::move(lock));
+        }
+    }
+
+    // Locks the node holding the element of h. Returns its index, or NotFound
+    // if h is not valid anymore. Waits while the element is being moved.
+    size_t lockElement(const Handle& h, NodeLock& lock)
+    {
+        for(;;)
+        {
+            if(!contains(h)) { return NotFound; }
+
+            size_t index = mSlots[h.mSlot].mPos.load(std::memory_order_acquire);
+            Node* node = mNodes.find(index);
+
+            if(node != nullptr)
+            {
+                lock = NodeLock(node->mLock);
+
+                if(node->mState == State::Full && node->mSlot == h.mSlot && contains(h))
+                {
+                    return index;
+                }
+
+                lock.unlock();
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    // Takes the element of the last position. Must be called with the size
+    // lock held on a non-empty heap. Waits until a pending insert fills the
+    // last position.
+    std::pair<T, SlotId> takeLast()
+    {
+        size_t last = mSize.load(std::memory_order_relaxed) - 1;
+        mSize.store(last, std::memory_order_relaxed);
+
+        Node& node = mNodes[last];
+        NodeLock lock(node.mLock);
+
+        while(node.mState != State::Full)
+        {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+
+        SlotId slot = node.mSlot;
+        return std::pair<T, SlotId>(takeValue(node), slot);
+    }
+
+    // Replaces the element of the locked node by value and restores the order.
+    void replaceLocked(size_t index, NodeLock lock, T&& value, SlotId slot)
+    {
+        Node& node = mNodes[index];
+        bool moveUp = compare(node.value(), value);
+
+        node.value() = std::move(value);
+        node.mSlot = slot;
+        setPos(slot, index);
+
+        if(moveUp)
+        {
+            std::uint32_t generation = mSlots[slot].mGeneration.load(std::memory_order_acquire);
+            lock.unlock();
+            siftUp(slot, generation);
+        }
+        else
+        {
+            siftDown(index, std::move(lock));
+        }
+    }
+
+    bool popOp(T* result)
+    {
+        NodeLock sizeLock(mSizeLock);
+        if(mSize.load(std::memory_order_relaxed) == 0) { return false; }
+
+        bool wasLast = mSize.load(std::memory_order_relaxed) == 1;
+        std::pair<T, SlotId> last = takeLast();
+        sizeLock.unlock();
+
+        if(!wasLast)
+        {
+            NodeLock rootLock(mNodes[0].mLock);
+            Node& root = mNodes[0];
+
+            // the root is empty only if other pops emptied the heap meanwhile,
+            // and it may have become worse than the last element by concurrent
+            // updates or pops, in both cases the last element is the top
+            if(root.mState == State::Full && !compare(root.value(), last.first))
+            {
+                SlotId topSlot = root.mSlot;
+                T top = std::move(root.value());
+
+                root.value() = std::move(last.first);
+                root.mSlot = last.second;
+                setPos(last.second, 0);
+                siftDown(0, std::move(rootLock));
+
+                last.first = std::move(top);
+                last.second = topSlot;
+            }
+        }
+
+        if(result != nullptr) { *result = std::move(last.first); }
+        releaseSlot(last.second);
+        return true;
+    }
+
+public:
+    using value_type = T;
+    using value_compare = Compare;
+
+    // Same requirements as Heap::Handle.
+    struct Handle
+    {
+    private:
+        SlotId mSlot = InvalidSlot;
+        std::uint32_t mGeneration = 0;
+
+        Handle(SlotId slot, std::uint32_t generation)
+            :mSlot(slot), mGeneration(generation) { }
+
+    public:
+        Handle() = default;
+
+        Handle(const Handle&) = default;
+
+        Handle(Handle&&) noexcept = default;
+
+        Handle& operator=(const Handle&) = default;
+
+        Handle& operator=(Handle&&) noexcept = default;
+
+        bool operator==(const Handle &o) const
+        {
+            return mSlot == o.mSlot && mGeneration == o.mGeneration;
+        }
+
+        bool operator!=(const Handle &o) const
+        {
+            return !(*this == o);
+        }
+
+        friend class ConcurrentHeap;
+    };
+
+    ConcurrentHeap() = default;
+
+    explicit ConcurrentHeap( const Compare & compare )
+        :CompareBase(compare) { }
+
+    ConcurrentHeap( const ConcurrentHeap & ) = delete;
+
+    ConcurrentHeap &operator=( const ConcurrentHeap & ) = delete;
+
+    Compare value_comp() const
+    {
+        return this->getCompare();
+    }
+
+    // O(n). Must not run concurrently with other operations.
+    ~ConcurrentHeap()
+    {
+        mNodes.forEach(mSize.load(), [](Node& node)
+        {
+            if(node.mState == State::Full) { node.value().~T(); }
+        });
+    }
+
+    // O(log n). Insert an element and return a handle for it.
+    Handle insert( T value )
+    {
+        NodeLock sizeLock(mSizeLock);
+        size_t target = mSize.load(std::memory_order_relaxed);
+
+        mNodes.ensure(target);
+        SlotId slot = acquireSlot();
+        Handle result(slot, mSlots[slot].mGeneration.load(std::memory_order_relaxed));
+
+        {
+            NodeLock targetLock(mNodes[target].mLock);
+            mNodes[target].mState = State::Pending;
+        }
+        mSize.store(target + 1, std::memory_order_relaxed);
+
+        size_t path[64];
+        size_t depth = 0;
+        for(size_t i = target; i > 0; i = (i - 1) / 2) { path[depth++] = i; }
+
+        size_t index = 0;
+        NodeLock lock(mNodes[0].mLock);
+        sizeLock.unlock();
+
+        while(index != target)
+        {
+            Node& node = mNodes[index];
+
+            if(compare(node.value(), value))
+            {
+                using std::swap;
+                swap(node.value(), value);
+                swap(node.mSlot, slot);
+                setPos(node.mSlot, index);
+            }
+
+            size_t next = path[--depth];
+            NodeLock nextLock(mNodes[next].mLock);
+            lock = std::move(nextLock);
+            index = next;
+        }
+
+        putValue(mNodes[target], target, std::move(value), slot);
+        return result;
+    }
+
+    // O(log n). Remove the top element and move it to result. Returns false
+    // if the heap was empty.
+    bool pop( T &result )
+    {
+        return popOp(&result);
+    }
+
+    // O(log n). Remove the top element. Returns false if the heap was empty.
+    bool pop()
+    {
+        return popOp(nullptr);
+    }
+
+    // O(1). Copy the top element to result. Returns false if the heap is empty.
+    bool top( T &result )
+    {
+        Node* root = mNodes.find(0);
+        if(root == nullptr) { return false; }
+
+        NodeLock lock(root->mLock);
+        if(root->mState != State::Full) { return false; }
+
+        result = root->value();
+        return true;
+    }
+
+    // O(1). Copy the element represented by h to result. Returns false if h is
+    // not valid anymore.
+    bool get( const Handle &h, T &result )
+    {
+        NodeLock lock;
+        size_t index = lockElement(h, lock);
+        if(index == NotFound) { return false; }
+
+        result = mNodes[index].value();
+        return true;
+    }
+
+    // O(1). Does the handle refer to an element of this heap?
+    bool contains( const Handle &h ) const
+    {
+        return h.mSlot < InvalidSlot && mSlots.find(h.mSlot) != nullptr &&
+               mSlots[h.mSlot].mGeneration.load(std::memory_order_acquire) == h.mGeneration;
+    }
+
+    // O(log n). Update the value represented by the given handle. Returns
+    // false if h is not valid anymore.
+    bool update( const Handle &h, T value )
+    {
+        NodeLock lock;
+        size_t index = lockElement(h, lock);
+        if(index == NotFound) { return false; }
+
+        replaceLocked(index, std::move(lock), std::move(value), h.mSlot);
+        return true;
+    }
+
+    // O(log n). Erase the value represented by the given handle. Returns false
+    // if h is not valid anymore.
+    bool erase( const Handle &h )
+    {
+        NodeLock sizeLock(mSizeLock);
+        if(!contains(h) || mSize.load(std::memory_order_relaxed) == 0) { return false; }
+
+        std::pair<T, SlotId> last = takeLast();
+
+        if(last.second == h.mSlot)
+        {
+            releaseSlot(last.second);
+            return true;
+        }
+
+        NodeLock lock;
+        size_t index = lockElement(h, lock);
+
+        if(index == NotFound)
+        {
+            // erased by someone else meanwhile, put the last element back.
+            // A pop may have sifted a worse element above its position while
+            // it was empty, so it is sifted up like an updated element.
+            size_t pos = mSize.load(std::memory_order_relaxed);
+            NodeLock lastLock(mNodes[pos].mLock);
+            putValue(mNodes[pos], pos, std::move(last.first), last.second);
+            mSize.store(pos + 1, std::memory_order_relaxed);
+
+            std::uint32_t generation = mSlots[last.second].mGeneration.load(std::memory_order_acquire);
+            lastLock.unlock();
+            sizeLock.unlock();
+            siftUp(last.second, generation);
+            return false;
+        }
+
+        sizeLock.unlock();
+        releaseSlot(h.mSlot);
+        replaceLocked(index, std::move(lock), std::move(last.first), last.second);
+        return true;
+    }
+
+    // O(1). The number of elements, including the ones being inserted.
+    size_t size() const
+    {
+        return mSize.load(std::memory_order_relaxed);
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return size() == 0;
+    }
+};
+
+#endif // CPP14_CONCURRENT_HEAP
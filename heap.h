@@ -3,20 +3,161 @@
  * Author: David Kuťák, 433409
 */
 #include <functional> // less
+#include <algorithm>
 #include <initializer_list>
 #include <vector>
 #include <utility>
-#include <list>
 #include <iterator>
 #include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <thread>
+#include <exception>
+#include <memory>
+#include <stdexcept>
 
 #ifndef CPP14_HEAP
 #define CPP14_HEAP
 
+template< typename T >
+struct IsPair : std::false_type { };
+
+template< typename A, typename B >
+struct IsPair< std::pair< A, B > > : std::true_type { };
+
+/*
+Holds the comparator of a Heap. Empty comparators are inherited from, so they
+take no space in the Heap (empty base optimization), other comparators are
+stored as a member.
+ */
+template< typename Compare,
+          bool = std::is_empty< Compare >::value && !std::is_final< Compare >::value >
+class CompareStorage : private Compare
+{
+public:
+    CompareStorage() = default;
+
+    explicit CompareStorage(const Compare& compare)
+        :Compare(compare) { }
+
+    Compare& getCompare() { return *this; }
+
+    const Compare& getCompare() const { return *this; }
+};
+
+template< typename Compare >
+class CompareStorage< Compare, false >
+{
+private:
+    Compare mCompare;
+
+public:
+    CompareStorage() = default;
+
+    explicit CompareStorage(const Compare& compare)
+        :mCompare(compare) { }
+
+    Compare& getCompare() { return mCompare; }
+
+    const Compare& getCompare() const { return mCompare; }
+};
+
+/*
+Number of threads used to build a Heap from an iterator range or to sort its
+values, see the iterator constructors and sortedValues of Heap. Zero means
+one thread per hardware thread for large inputs.
+ */
+struct BuildThreads
+{
+    size_t mCount;
+
+    explicit BuildThreads(size_t count = 0)
+        :mCount(count) { }
+};
+
+// The operations of a Heap which a statistics policy can time.
+enum class HeapOperation { Insert, Pop, Update, Erase };
+
+/*
+Statistics policies of Heap, see its Stats parameter. The Heap reports every
+call of its comparator while it builds or changes the heap, every move of an
+element to another position of the heap, the depth of every sift (the number
+of levels the element moved, zero if it stayed) and every bottom-up heapify
+of the whole heap or of a large batch. The calls made to read the values in
+order, by topK and sortedValues, are not reported. Single inserts, pops,
+updates and erases are bracketed by startOperation and finishOperation, which
+gets the value returned by startOperation. NoHeapStats ignores all of it, it
+takes no space in the Heap and its calls compile to nothing. Other policies
+derive from it and hide the hooks they need.
+ */
+struct NoHeapStats
+{
+    // Whether the counting hooks may be called from more threads at once,
+    // otherwise the Heap is always built on one thread.
+    static constexpr bool ParallelBuild = true;
+
+    int startOperation() { return 0; }
+
+    void finishOperation(HeapOperation, int) { }
+
+    void countComparison() { }
+
+    void countMove() { }
+
+    void countSiftUp(size_t) { }
+
+    void countSiftDown(size_t) { }
+
+    void countRebuild() { }
+};
+
+/*
+Counts the operations of a Heap, read them through Heap::stats. The counters
+are plain integers, so a Heap with HeapStats is always built on one thread.
+ */
+struct HeapStats : NoHeapStats
+{
+    static constexpr bool ParallelBuild = false;
+
+    std::uint64_t mComparisons = 0;
+    std::uint64_t mMoves = 0;
+    std::uint64_t mSiftUps = 0;
+    std::uint64_t mSiftUpLevels = 0;
+    std::uint64_t mMaxSiftUpDepth = 0;
+    std::uint64_t mSiftDowns = 0;
+    std::uint64_t mSiftDownLevels = 0;
+    std::uint64_t mMaxSiftDownDepth = 0;
+    std::uint64_t mRebuilds = 0;
+
+    void countComparison() { ++mComparisons; }
+
+    void countMove() { ++mMoves; }
+
+    void countSiftUp(size_t depth)
+    {
+        ++mSiftUps;
+        mSiftUpLevels += depth;
+        mMaxSiftUpDepth = std::max<std::uint64_t>(mMaxSiftUpDepth, depth);
+    }
+
+    void countSiftDown(size_t depth)
+    {
+        ++mSiftDowns;
+        mSiftDownLevels += depth;
+        mMaxSiftDownDepth = std::max<std::uint64_t>(mMaxSiftDownDepth, depth);
+    }
+
+    void countRebuild() { ++mRebuilds; }
+
+    void reset() { *this = HeapStats(); }
+};
+
 /*
 The heap type, parametrized by the type of elements and by the type that
-defines a comparator. The comparator is expected to be stateless and default
-constructible, so it does not need to be stored in the Heap. The ordering of
+defines a comparator. The Heap stores a copy of the comparator, which can be
+passed to the constructors the same way as to std::priority_queue, so the
+comparator may carry state. Stateless comparators take no space. The ordering of
 the heap depends on the type supplied to Compare, for example, with std::less<
 T > it creates a max-heap (this behaviour mirrors the one of
 std::priority_queue), see the end of this file for some pre-defined heaps with
@@ -36,109 +177,718 @@ push_back to have constant complexity, although in fact it is only amortized
 constant). For each of the operations there is a complexity requirement that you
 have to meet. You are free to choose the type of the elements stored in the vector
 and you can use any additional data structures that you wish.
+
+The optional Arity parameter sets the number of children of each node. The
+default gives the binary heap described above, wider heaps are shallower, so
+they need fewer levels per sift at the cost of more comparisons per level.
+
+The optional Stats parameter is a statistics policy, which the heap tells
+about its comparisons, moves, sifts and rebuilds, see HeapStats. The default
+NoHeapStats counts nothing and costs nothing.
  */
-template< typename T, typename Compare >
-class Heap
+template< typename T, typename Compare, size_t Arity = 2, typename Stats = NoHeapStats >
+class Heap : private CompareStorage< Compare >, private Stats
 {
+    using CompareBase = CompareStorage< Compare >;
+
+    static_assert(Arity >= 2, "Heap needs at least two children per node");
+
 public:
     struct Handle; // Forward declare handle for use in private functions
 private:
-    std::vector<std::pair<T, std::list<size_t>::iterator>> mHeapData;
-    std::list<size_t> mValPos;
+    using SlotId = std::uint32_t;
+
+    static constexpr SlotId InvalidSlot = std::numeric_limits<SlotId>::max();
+
+    // Ranges at least this long are built on all hardware threads.
+    static constexpr size_t ParallelBuildThreshold = size_t(1) << 17;
+
+    // Whether threads are started without an explicit thread count. Only
+    // empty comparators are called from more threads on their own, others
+    // may carry state which the threads would race on.
+    static constexpr bool AutoParallel = Stats::ParallelBuild && std::is_empty< Compare >::value;
+
+    // Handle table entry. A live slot stores the position of its element in
+    // mHeapData, a free slot stores the next free slot. The generation is odd
+    // while the slot is live, so stale and default handles never match.
+    struct Slot
+    {
+        SlotId mPos;
+        std::uint32_t mGeneration;
+    };
+
+    // The handle table, kept in blocks of fixed size. Slots never move, so
+    // handles point to them directly, and merge can move the blocks of one
+    // heap behind the blocks of another without invalidating any handle.
+    class SlotTable
+    {
+    private:
+        static constexpr size_t BlockBits = 10;
+        static constexpr size_t BlockSize = size_t(1) << BlockBits;
+
+        std::vector<std::unique_ptr<Slot[]>> mBlocks;
+        size_t mSize = 0;
+
+        void addBlock()
+        {
+            checkCapacity(capacity() + BlockSize);
+            mBlocks.emplace_back(new Slot[BlockSize]());
+        }
+
+    public:
+        // Throws std::length_error if slot ids below count do not fit in
+        // SlotId, InvalidSlot itself is never a slot.
+        static void checkCapacity(size_t count)
+        {
+            if(count > InvalidSlot)
+            {
+                throw std::length_error("Heap: too many handles");
+            }
+        }
+
+        SlotTable() = default;
+
+        SlotTable(const SlotTable& other)
+            :mSize(other.mSize)
+        {
+            mBlocks.reserve(other.mBlocks.size());
+
+            for(const auto& block : other.mBlocks)
+            {
+                addBlock();
+                std::copy(block.get(), block.get() + BlockSize, mBlocks.back().get());
+            }
+        }
+
+        SlotTable(SlotTable&&) noexcept = default;
+
+        SlotTable& operator=(const SlotTable& other)
+        {
+            SlotTable copy(other);
+            return *this = std::move(copy);
+        }
+
+        SlotTable& operator=(SlotTable&&) noexcept = default;
+
+        Slot& operator[](SlotId slot)
+        {
+            return mBlocks[slot >> BlockBits][slot & (BlockSize - 1)];
+        }
+
+        const Slot& operator[](SlotId slot) const
+        {
+            return mBlocks[slot >> BlockBits][slot & (BlockSize - 1)];
+        }
+
+        // The number of slots ever handed out.
+        size_t size() const
+        {
+            return mSize;
+        }
+
+        size_t capacity() const
+        {
+            return mBlocks.size() * BlockSize;
+        }
+
+        SlotId push_back(const Slot& slot)
+        {
+            if(mSize == capacity()) { addBlock(); }
+
+            (*this)[static_cast<SlotId>(mSize)] = slot;
+            return static_cast<SlotId>(mSize++);
+        }
+
+        void reserve(size_t count)
+        {
+            while(capacity() < count) { addBlock(); }
+        }
+
+        void resize(size_t count)
+        {
+            reserve(count);
+            mSize = count;
+        }
+
+        // Moves the blocks of other behind the blocks of this, slot s of
+        // other becomes slot capacity() + s of this. Returns that offset.
+        SlotId splice(SlotTable& other)
+        {
+            SlotId offset = static_cast<SlotId>(capacity());
+
+            mBlocks.insert(mBlocks.end(), std::make_move_iterator(other.mBlocks.begin()),
+                           std::make_move_iterator(other.mBlocks.end()));
+            mSize = offset + other.mSize;
+
+            other.mBlocks.clear();
+            other.mSize = 0;
+            return offset;
+        }
+    };
+
+    std::vector<std::pair<T, SlotId>> mHeapData;
+    SlotTable mSlots;
+    SlotId mFreeSlot = InvalidSlot;
 
     const T& getValAtPos(size_t index) const
     {
         return mHeapData[index].first;
     }
 
-    void swapElementsAtIndices(size_t first, size_t second)
+    bool compare(const T& lhs, const T& rhs)
     {
-        if(first == second) { return; }
+        this->countComparison();
+        return this->getCompare()(lhs, rhs);
+    }
 
-        *mHeapData[first].second = second;
-        *mHeapData[second].second = first;
-        std::swap(mHeapData[first], mHeapData[second]);
+    size_t getPosOf(const Handle& h) const
+    {
+        return h.mSlot->mPos;
     }
 
-    unsigned getLeftChildOf(size_t index) const
+    SlotId acquireSlot(size_t pos)
     {
-        return 2 * index + 1;
+        SlotId slot = mFreeSlot;
+
+        if(slot == InvalidSlot)
+        {
+            slot = mSlots.push_back(Slot{ 0, 0 });
+        }
+
+        Slot& entry = mSlots[slot];
+
+        if(slot == mFreeSlot)
+        {
+            mFreeSlot = entry.mPos;
+        }
+
+        entry.mPos = static_cast<SlotId>(pos);
+        ++entry.mGeneration;
+
+        return slot;
+    }
+
+    void releaseSlot(SlotId slot)
+    {
+        mSlots[slot].mPos = mFreeSlot;
+        ++mSlots[slot].mGeneration;
+        mFreeSlot = slot;
+    }
+
+    // Moves the element at index from into the hole at index to and points
+    // its handle at the new position. The slot at from becomes the hole.
+    void moveElement(size_t from, size_t to)
+    {
+        this->countMove();
+        mSlots[mHeapData[from].second].mPos = static_cast<SlotId>(to);
+        mHeapData[to] = std::move(mHeapData[from]);
+    }
+
+    void placeElement(size_t index, std::pair<T, SlotId>&& element)
+    {
+        this->countMove();
+        mSlots[element.second].mPos = static_cast<SlotId>(index);
+        mHeapData[index] = std::move(element);
     }
 
-    unsigned getRightChildOf(size_t index) const
+    size_t getFirstChildOf(size_t index) const
     {
-        return 2 * index + 2;
+        return Arity * index + 1;
     }
 
-    unsigned getParentOf(size_t index) const
+    size_t getParentOf(size_t index) const
     {
-        return (index - 1) / 2;
+        return (index - 1) / Arity;
     }
 
-    void bubbleUp(size_t index)
+    // Returns the child of index which should be closer to the top, or the
+    // size of the heap if index is a leaf.
+    size_t getTopChildOf(size_t index)
     {
-        if(index <= 0 || index >= mHeapData.size()) { return; }
+        size_t child = getFirstChildOf(index);
+
+        if(child >= mHeapData.size()) { return mHeapData.size(); }
+
+        size_t last = std::min(child + Arity, mHeapData.size());
+        size_t selectedChild = child;
+
+        for(++child; child < last; ++child)
+        {
+            if(compare(getValAtPos(selectedChild), getValAtPos(child)))
+            {
+                selectedChild = child;
+            }
+        }
+
+        return selectedChild;
+    }
+
+    // Sifts the element at index towards the root. The element is moved out
+    // once, parents are shifted down into the hole and the element is placed
+    // at its final position. Returns that position.
+    size_t bubbleUp(size_t index)
+    {
+        if(index == 0 || index >= mHeapData.size()) { return index; }
 
         size_t parent = getParentOf(index);
-        if(!Compare()(getValAtPos(index), getValAtPos(parent)))
+        if(!compare(getValAtPos(parent), getValAtPos(index)))
+        {
+            this->countSiftUp(0);
+            return index;
+        }
+
+        std::pair<T, SlotId> element = std::move(mHeapData[index]);
+        size_t levels = 0;
+
+        do
+        {
+            moveElement(parent, index);
+            index = parent;
+            parent = getParentOf(index);
+            ++levels;
+        } while(index > 0 && compare(getValAtPos(parent), element.first));
+
+        placeElement(index, std::move(element));
+        this->countSiftUp(levels);
+        return index;
+    }
+
+    // Sifts the element at index towards the leaves, shifting children up into
+    // the hole. Returns the final position of the element.
+    size_t bubbleDown(size_t index)
+    {
+        size_t child = getTopChildOf(index);
+        if(child >= mHeapData.size() || !compare(getValAtPos(index), getValAtPos(child)))
+        {
+            this->countSiftDown(0);
+            return index;
+        }
+
+        std::pair<T, SlotId> element = std::move(mHeapData[index]);
+        size_t levels = 0;
+
+        do
+        {
+            moveElement(child, index);
+            index = child;
+            child = getTopChildOf(index);
+            ++levels;
+        } while(child < mHeapData.size() && compare(element.first, getValAtPos(child)));
+
+        placeElement(index, std::move(element));
+        this->countSiftDown(levels);
+        return index;
+    }
+
+    void buildHeap()
+    {
+        if(mHeapData.size() < 2) { return; }
+
+        this->countRebuild();
+        for(size_t i = getParentOf(mHeapData.size() - 1) + 1; i-- > 0; )
         {
-            swapElementsAtIndices(index, parent);
-            bubbleUp(parent);
+            bubbleDown(i);
         }
     }
 
-    void bubbleDown(size_t index)
+    // Heapifies the subtrees rooted at the nodes [begin, end) of one level,
+    // deepest level first. Subtrees of different roots share no nodes, so
+    // disjoint ranges of roots can be heapified by different threads.
+    void heapifySubtrees(size_t begin, size_t end)
     {
-        if(index < 0 || index >= mHeapData.size()) { return; }
+        size_t parents = getParentOf(mHeapData.size() - 1) + 1;
+        size_t levelBegin[64];
+        size_t levelEnd[64];
+        size_t depth = 0;
 
-        size_t leftChild = getLeftChildOf(index);
-        size_t rightChild = getRightChildOf(index);
-        size_t selectedChild = index;
+        for(; begin < parents; begin = getFirstChildOf(begin), end = getFirstChildOf(end))
+        {
+            levelBegin[depth] = begin;
+            levelEnd[depth++] = std::min(end, parents);
+        }
 
-        if(leftChild < mHeapData.size() &&
-           !Compare()(getValAtPos(leftChild), getValAtPos(selectedChild)))
+        while(depth-- > 0)
         {
-            selectedChild = leftChild;
+            for(size_t i = levelEnd[depth]; i-- > levelBegin[depth]; )
+            {
+                bubbleDown(i);
+            }
         }
+    }
 
-        if(rightChild < mHeapData.size() &&
-           !Compare()(getValAtPos(rightChild), getValAtPos(selectedChild)))
+    // Calls fn(begin, end) for threadCount chunks of [0, count), one of them
+    // on the calling thread. Exceptions of the workers are rethrown.
+    template< typename Fn >
+    static void parallelFor(size_t count, size_t threadCount, Fn fn)
+    {
+        size_t chunk = (count + threadCount - 1) / threadCount;
+        std::vector<std::exception_ptr> errors(threadCount);
+        std::vector<std::thread> workers;
+
+        for(size_t begin = chunk, worker = 1; begin < count; begin += chunk, ++worker)
         {
-            selectedChild = rightChild;
+            workers.emplace_back([&, begin, worker]
+            {
+                try { fn(begin, std::min(count, begin + chunk)); }
+                catch(...) { errors[worker] = std::current_exception(); }
+            });
         }
 
-        if(selectedChild != index)
+        try { fn(0, std::min(count, chunk)); }
+        catch(...) { errors[0] = std::current_exception(); }
+
+        for(auto& worker : workers) { worker.join(); }
+
+        for(auto& error : errors)
         {
-            swapElementsAtIndices(index, selectedChild);
-            bubbleDown(selectedChild);
+            if(error) { std::rethrow_exception(error); }
         }
     }
 
-    void buildHeap()
+    // Builds the heap from a random access range on threadCount threads: the
+    // elements and their slots are filled in chunks, then the subtrees below
+    // a level with enough nodes for all threads are heapified in parallel and
+    // the few levels above them serially.
+    template< typename Iterator >
+    void buildParallel(Iterator first, size_t count, size_t threadCount)
     {
-        for(int i=(mHeapData.size()-1)/2; i>=0; --i)
+        mHeapData.resize(count);
+        mSlots.resize(count);
+
+        parallelFor(count, threadCount, [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                mHeapData[i].first = first[i];
+                mHeapData[i].second = static_cast<SlotId>(i);
+                mSlots[i] = Slot{ static_cast<SlotId>(i), 1 };
+            }
+        });
+
+        if(count < 2) { return; }
+
+        this->countRebuild();
+        size_t parents = getParentOf(count - 1) + 1;
+        size_t begin = 0;
+        size_t end = 1;
+
+        while(end - begin < 8 * threadCount && getFirstChildOf(begin) < parents)
+        {
+            begin = getFirstChildOf(begin);
+            end = getFirstChildOf(end);
+        }
+
+        end = std::min(end, parents);
+        parallelFor(end - begin, threadCount, [&](size_t from, size_t to)
+        {
+            heapifySubtrees(begin + from, begin + to);
+        });
+
+        for(size_t i = begin; i-- > 0; )
         {
             bubbleDown(i);
         }
     }
 
+    template< typename Iterator >
+    void buildFrom(Iterator first, Iterator last, size_t threadCount, std::random_access_iterator_tag)
+    {
+        if(!Stats::ParallelBuild) { threadCount = 1; }
+
+        if(threadCount == 0)
+        {
+            threadCount = AutoParallel ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+            if(threadCount == 1 || size_t(last - first) < ParallelBuildThreshold)
+            {
+                buildFrom(first, last, 1, std::input_iterator_tag());
+                return;
+            }
+        }
+
+        buildParallel(first, last - first, threadCount);
+    }
+
+    template< typename Iterator >
+    void buildFrom(Iterator first, Iterator last, size_t, std::input_iterator_tag)
+    {
+        appendRange(first, last);
+        buildHeap();
+    }
+
+    // Sorts the values of the heap to the order they would be popped in. The
+    // values of a binary heap already form a heap in the layout of the
+    // standard library, so they are heapsorted in place. On more threads the
+    // values are sorted in chunks, which are then merged pairwise. The
+    // threads are chosen the way buildFrom chooses them.
+    void sortValues(std::vector<T>& values, size_t threadCount) const
+    {
+        Compare compare = this->getCompare();
+        auto topFirst = [&compare](const T& lhs, const T& rhs) { return compare(rhs, lhs); };
+        size_t count = values.size();
+
+        if(!Stats::ParallelBuild) { threadCount = 1; }
+
+        if(threadCount == 0)
+        {
+            threadCount = AutoParallel && count >= ParallelBuildThreshold ?
+                std::max(1u, std::thread::hardware_concurrency()) : 1;
+        }
+
+        if(threadCount > 1)
+        {
+            parallelFor(count, threadCount, [&](size_t begin, size_t end)
+            {
+                std::sort(values.begin() + begin, values.begin() + end, topFirst);
+            });
+
+            for(size_t width = (count + threadCount - 1) / threadCount; width < count; width *= 2)
+            {
+                parallelFor((count + 2 * width - 1) / (2 * width), threadCount, [&](size_t begin, size_t end)
+                {
+                    for(size_t pair = begin; pair < end; ++pair)
+                    {
+                        size_t low = 2 * width * pair;
+                        std::inplace_merge(values.begin() + low,
+                                           values.begin() + std::min(count, low + width),
+                                           values.begin() + std::min(count, low + 2 * width), topFirst);
+                    }
+                });
+            }
+        }
+        else if(Arity == 2)
+        {
+            std::sort_heap(values.begin(), values.end(), compare);
+            std::reverse(values.begin(), values.end());
+        }
+        else
+        {
+            std::sort(values.begin(), values.end(), topFirst);
+        }
+    }
+
+    // Compares the new value with the old one, so the element is sifted only
+    // in the direction it moved.
     void updateOp(const Handle& h, T&& value)
     {
-        mHeapData[*h.mIter].first = std::move(value);
+        auto start = this->startOperation();
+        size_t pos = getPosOf(h);
+        bool moveUp = compare(getValAtPos(pos), value);
+        mHeapData[pos].first = std::move(value);
+
+        if(moveUp) { bubbleUp(pos); }
+        else { bubbleDown(pos); }
+
+        this->finishOperation(HeapOperation::Update, start);
+    }
+
+    void restoreOrderAt(size_t pos)
+    {
+        if(bubbleDown(pos) == pos) { bubbleUp(pos); }
+    }
+
+    void eraseOp(const Handle& h, HeapOperation operation)
+    {
+        auto start = this->startOperation();
+        size_t position = getPosOf(h);
+        size_t last = mHeapData.size()-1;
+
+        releaseSlot(mHeapData[position].second);
+        if(position != last) { moveElement(last, position); }
+        mHeapData.pop_back();
+
+        if(position < mHeapData.size()) { restoreOrderAt(position); }
+
+        this->finishOperation(operation, start);
+    }
+
+    Handle replaceTopOp(T&& value)
+    {
+        if(empty()) { return emplaceOp(std::move(value)); }
+
+        Handle result = getHandleAt(0);
+        mHeapData[0].first = std::move(value);
+
+        bubbleDown(0);
+        return result;
+    }
+
+    T pushPopOp(T&& value)
+    {
+        if(empty() || !compare(value, getValAtPos(0))) { return std::move(value); }
+
+        T result = std::move(mHeapData[0].first);
+        mHeapData[0].first = std::move(value);
+
+        bubbleDown(0);
+        return result;
+    }
+
+    void promoteOp(const Handle& h, T&& value)
+    {
+        auto start = this->startOperation();
+        size_t pos = getPosOf(h);
+        mHeapData[pos].first = std::move(value);
 
-        size_t pos = *h.mIter;
-        bubbleDown(pos);
         bubbleUp(pos);
+        this->finishOperation(HeapOperation::Update, start);
+    }
+
+    void demoteOp(const Handle& h, T&& value)
+    {
+        auto start = this->startOperation();
+        size_t pos = getPosOf(h);
+        mHeapData[pos].first = std::move(value);
+
+        bubbleDown(pos);
+        this->finishOperation(HeapOperation::Update, start);
+    }
+
+    Handle getHandleAt(size_t index) const
+    {
+        const Slot& slot = mSlots[mHeapData[index].second];
+        return Handle(&slot, slot.mGeneration);
+    }
+
+    // Constructs an element directly at the end of mHeapData from args,
+    // without restoring the heap order.
+    template< typename... Args >
+    SlotId emplaceBack(Args&&... args)
+    {
+        SlotId slot = acquireSlot(mHeapData.size());
+
+        try
+        {
+            mHeapData.emplace_back(std::piecewise_construct,
+                                   std::forward_as_tuple(std::forward<Args>(args)...),
+                                   std::forward_as_tuple(slot));
+        }
+        catch(...)
+        {
+            releaseSlot(slot);
+            throw;
+        }
+
+        return slot;
     }
 
-    Handle insertOp(T&& value)
+    template< typename... Args >
+    Handle emplaceOp(Args&&... args)
     {
-        Handle result(mValPos.insert(mValPos.end(), mHeapData.size()));
-        mHeapData.push_back(std::make_pair(std::move(value), result.mIter));
+        auto start = this->startOperation();
+        SlotId slot = emplaceBack(std::forward<Args>(args)...);
 
         bubbleUp(mHeapData.size()-1);
+        this->finishOperation(HeapOperation::Insert, start);
 
-        return result;
+        const Slot& entry = mSlots[slot];
+        return Handle(&entry, entry.mGeneration);
+    }
+
+    template< typename Iterator >
+    void reserveFor(Iterator, Iterator, std::input_iterator_tag) { }
+
+    // Keeps the geometric growth of the vector, so that repeated small
+    // batches do not reallocate every time.
+    template< typename Iterator >
+    void reserveFor(Iterator first, Iterator last, std::forward_iterator_tag)
+    {
+        size_t needed = mHeapData.size() + std::distance(first, last);
+
+        if(needed > mHeapData.capacity())
+        {
+            mHeapData.reserve(std::max(needed, 2 * mHeapData.capacity()));
+        }
+    }
+
+    template< typename Iterator >
+    void appendRange(Iterator first, Iterator last)
+    {
+        reserveFor(first, last, typename std::iterator_traits< Iterator >::iterator_category());
+
+        for(; first != last; ++first)
+        {
+            emplaceBack(*first);
+        }
+    }
+
+    size_t getDepth() const
+    {
+        size_t depth = 0;
+
+        for(size_t i = mHeapData.size(); i > 1; i = getParentOf(i - 1) + 1)
+        {
+            ++depth;
+        }
+
+        return depth;
+    }
+
+    bool isLive(SlotId slot) const
+    {
+        return mSlots[slot].mGeneration % 2 == 1;
+    }
+
+    // Removes all elements from position from on whose slots were released,
+    // shifting the remaining ones down in one pass. The elements before from
+    // are not touched, so the order has to be restored from there on.
+    void compactFrom(size_t from)
+    {
+        size_t write = from;
+
+        for(size_t read = from; read < mHeapData.size(); ++read)
+        {
+            if(!isLive(mHeapData[read].second)) { continue; }
+
+            if(read != write) { moveElement(read, write); }
+            ++write;
+        }
+
+        mHeapData.erase(mHeapData.begin() + write, mHeapData.end());
+    }
+
+    // Restores the heap order after the elements from position first on were
+    // appended or shifted, while the ones before first form a heap. A batch
+    // not longer than the depth of the heap is sifted up element by element.
+    // Larger batches are heapified bottom-up like in buildHeap, but only the
+    // batch and its ancestors are visited.
+    void restoreAppended(size_t first)
+    {
+        if(first >= mHeapData.size()) { return; }
+
+        if(first == 0)
+        {
+            buildHeap();
+            return;
+        }
+
+        size_t last = mHeapData.size();
+        if(last - first <= getDepth())
+        {
+            for(size_t i = first; i < last; ++i)
+            {
+                bubbleUp(i);
+            }
+            return;
+        }
+
+        size_t lastParent = getParentOf(last - 1);
+        size_t low = first;
+        size_t high = last - 1;
+
+        this->countRebuild();
+
+        for(;;)
+        {
+            for(size_t i = std::min(high, lastParent) + 1; i-- > low; )
+            {
+                bubbleDown(i);
+            }
+
+            if(low == 0) { break; }
+
+            high = std::min(getParentOf(high), low - 1);
+            low = getParentOf(low);
+        }
     }
 
 public:
@@ -152,10 +902,11 @@ public:
     struct Handle
     {
     private:
-        std::list<size_t>::iterator mIter;
+        const Slot* mSlot = nullptr;
+        std::uint32_t mGeneration = 0;
 
-        Handle(std::list<size_t>::iterator iter)
-            :mIter(iter) { }
+        Handle(const Slot* slot, std::uint32_t generation)
+            :mSlot(slot), mGeneration(generation) { }
 
     public:
         Handle() = default;
@@ -170,7 +921,7 @@ public:
 
         bool operator==(const Handle &o) const
         {
-            return mIter == o.mIter;
+            return mSlot == o.mSlot && mGeneration == o.mGeneration;
         }
 
         bool operator!=(const Handle &o) const
@@ -178,45 +929,66 @@ public:
             return !(*this == o);
         }
 
-        friend class Heap<T, Compare>;
+        friend class Heap;
     };
 
+    using value_compare = Compare;
+
     // O(1). Heap is default constructible in constant time.
     Heap() = default;
 
+    // O(1). Create an empty heap ordered by the given comparator.
+    explicit Heap( const Compare & compare )
+        :CompareBase(compare) { }
+
     // O(n) where n is the size of other. Heap is copy constructible. Copy does
     // not affect other (and its handles) in any way, the handles from other
     // should not be used with this.
-    Heap( const Heap & other )
-    {
-        for(size_t i = 0; i < other.mHeapData.size(); ++i)
-        {
-            mHeapData.push_back(std::make_pair(other.mHeapData[i].first, mValPos.insert(mValPos.end(), i)));
-        }
-    }
+    Heap( const Heap & other ) = default;
 
     // O(1). Heap is move constructible. After the move, no operations other
     // than destruction or assignment should be done with other and all handles
     // for other should now be valid handles for this.
-    Heap( Heap && other ) noexcept = default;
+    Heap( Heap && other ) noexcept(std::is_nothrow_copy_constructible< Compare >::value &&
+                                    std::is_nothrow_move_constructible< Stats >::value)
+        :CompareBase(other.getCompare()),
+         Stats(std::move(other.stats())),
+         mHeapData(std::move(other.mHeapData)),
+         mSlots(std::move(other.mSlots)),
+         mFreeSlot(other.mFreeSlot)
+    {
+        other.mFreeSlot = InvalidSlot;
+    }
 
     // O(n) where n is the distance from begin to end. Heap can be created from
     // an iterator range in linear time (provided that the iterator has
-    // constant time dereference and increment).
+    // constant time dereference and increment). Large random access ranges
+    // are built on all hardware threads if the comparator is empty, see the
+    // next constructor.
+    template< typename Iterator >
+    Heap( Iterator begin, Iterator end, const Compare & compare = Compare() )
+        :Heap(begin, end, BuildThreads(), compare) { }
+
+    // O(n / p + log^2 n) with p threads. A random access range is copied and
+    // heapified in parallel, which needs T to be default constructible and
+    // the comparator to be callable from more threads at once. Without an
+    // explicit thread count, only ranges of at least ParallelBuildThreshold
+    // elements with an empty comparator are built in parallel, comparators
+    // with state are only shared between threads if asked to.
     template< typename Iterator >
-    Heap( Iterator begin, Iterator end ) : Heap()
+    Heap( Iterator begin, Iterator end, BuildThreads threads, const Compare & compare = Compare() )
+        :CompareBase(compare)
     {
-        unsigned i = 0;
-        for(auto it = begin; it != end; ++it, ++i)
-        {
-            mHeapData.push_back(std::make_pair(*it, mValPos.insert(mValPos.end(), i)));
-        }
+        using Category = typename std::conditional< std::is_default_constructible< T >::value,
+            typename std::iterator_traits< Iterator >::iterator_category,
+            std::input_iterator_tag >::type;
 
-        buildHeap();
+        buildFrom(begin, end, threads.mCount, Category());
     }
 
     // O(n) where n is the number of elements in list.
-    Heap( std::initializer_list< T > list ) : Heap(list.begin(), list.end()) { }
+    Heap( std::initializer_list< T > list, const Compare & compare = Compare() )
+        :Heap(list.begin(), list.end(), compare) { }
 
     // O(n) where n is the size of other. Heap is copy assignable. Assignment
     // does not affect other in any way, the handles from other should not be
@@ -240,8 +1012,129 @@ public:
     void swap( Heap &other )
     {
         using std::swap;
+        swap(this->getCompare(), other.getCompare());
+        swap(stats(), other.stats());
         swap(mHeapData, other.mHeapData);
-        swap(mValPos, other.mValPos);
+        swap(mSlots, other.mSlots);
+        swap(mFreeSlot, other.mFreeSlot);
+    }
+
+    // O(m + log^2 n), where m is the size of the smaller heap and n of the
+    // larger one. Moves all elements of other into this and leaves other
+    // empty. The handle table of the larger heap is kept. If the elements of
+    // the smaller heap fill at least half of its handle table, which holds
+    // for heaps of at least 512 elements that did not shrink much, that table
+    // is moved behind the kept one block by block and all handles for both
+    // heaps stay valid. Otherwise the elements of the smaller heap get new
+    // handles of this, so its old handles become invalid, and its table is
+    // left to it instead of adding mostly unused blocks to this. The smaller
+    // heap is appended and sifted up or heapified bottom-up, whichever is
+    // cheaper. Throws std::length_error if the merged handle table would run
+    // out of handle ids, then both heaps are left unchanged. Precondition:
+    // both heaps are ordered the same way.
+    void merge( Heap &&other )
+    {
+        if(&other == this) { return; }
+
+        bool swapHeaps = other.mHeapData.size() > mHeapData.size();
+        Heap& larger = swapHeaps ? other : *this;
+        const Heap& smaller = swapHeaps ? *this : other;
+        bool spliceSlots = 2 * smaller.mHeapData.size() >= smaller.mSlots.capacity();
+
+        // everything that can throw happens before the heaps are touched
+        if(spliceSlots)
+        {
+            SlotTable::checkCapacity(mSlots.capacity() + other.mSlots.capacity());
+        }
+        else
+        {
+            larger.mSlots.reserve(larger.mSlots.size() + smaller.mHeapData.size());
+        }
+
+        size_t needed = mHeapData.size() + other.mHeapData.size();
+
+        if(needed > larger.mHeapData.capacity())
+        {
+            larger.mHeapData.reserve(std::max(needed, 2 * larger.mHeapData.capacity()));
+        }
+
+        if(swapHeaps)
+        {
+            using std::swap;
+            swap(mHeapData, other.mHeapData);
+            swap(mSlots, other.mSlots);
+            swap(mFreeSlot, other.mFreeSlot);
+        }
+
+        size_t first = mHeapData.size();
+
+        if(!spliceSlots)
+        {
+            for(auto& element : other.mHeapData)
+            {
+                other.releaseSlot(element.second);
+                SlotId slot = acquireSlot(mHeapData.size());
+                mHeapData.emplace_back(std::move(element.first), slot);
+            }
+
+            other.mHeapData.clear();
+            restoreAppended(first);
+            return;
+        }
+
+        // the unused slots of the last block are skipped by the splice
+        for(size_t slot = mSlots.capacity(); slot-- > mSlots.size(); )
+        {
+            mSlots[static_cast<SlotId>(slot)].mPos = mFreeSlot;
+            mFreeSlot = static_cast<SlotId>(slot);
+        }
+
+        SlotId offset = mSlots.splice(other.mSlots);
+
+        if(other.mFreeSlot != InvalidSlot)
+        {
+            SlotId slot = other.mFreeSlot + offset;
+
+            for(; mSlots[slot].mPos != InvalidSlot; slot = mSlots[slot].mPos)
+            {
+                mSlots[slot].mPos += offset;
+            }
+
+            mSlots[slot].mPos = mFreeSlot;
+            mFreeSlot = other.mFreeSlot + offset;
+            other.mFreeSlot = InvalidSlot;
+        }
+
+        for(auto& element : other.mHeapData)
+        {
+            SlotId slot = element.second + offset;
+
+            mSlots[slot].mPos = static_cast<SlotId>(mHeapData.size());
+            mHeapData.emplace_back(std::move(element.first), slot);
+        }
+
+        other.mHeapData.clear();
+        restoreAppended(first);
+    }
+
+    // O(1). Get the comparator the heap is ordered by.
+    Compare value_comp() const
+    {
+        return this->getCompare();
+    }
+
+    // O(1). Get the statistics policy, which counted all operations since
+    // the heap was created. Copies and moves of the heap take its statistics
+    // along, swap exchanges them, merge keeps the statistics of this.
+    const Stats &stats() const
+    {
+        return *this;
+    }
+
+    // O(1). A version of stats which allows to reset the counters.
+    Stats &stats()
+    {
+        return *this;
     }
 
     // O(1). Get the top (e.g. maximal for max-heap) element of the heap.
@@ -253,35 +1146,142 @@ public:
     // O(1). Get handle to the top element of the heap.
     Handle topHandle() const
     {
-        return Handle(mHeapData[0].second);
+        return getHandleAt(0);
     }
 
     // O(log n). Remove the top element from the heap. This invalidates handle
     // to the removed element, handles to other elements must remain valid.
     void pop()
     {
-        if(!empty()) { erase(topHandle()); }
+        if(!empty()) { eraseOp(topHandle(), HeapOperation::Pop); }
+    }
+
+    // O(log n). Replace the top element by value with a single sift down from
+    // the root, which is cheaper than pop followed by insert. The handle of
+    // the top element is kept and now represents value, it is returned. On an
+    // empty heap this is the same as insert.
+    Handle replaceTop( const T &value )
+    {
+        return replaceTopOp(T(value));
+    }
+
+    // O(log n). A version of replaceTop which uses move assign.
+    Handle replaceTop( T &&value )
+    {
+        return replaceTopOp(std::move(value));
+    }
+
+    // O(log n). Insert value and remove the top element in a single sift down
+    // from the root. Returns the removed element, which is value itself if it
+    // would become the top, the heap is unchanged then. Otherwise value takes
+    // over the handle of the removed top element.
+    T pushPop( const T &value )
+    {
+        return pushPopOp(T(value));
+    }
+
+    // O(log n). A version of pushPop which moves value into the heap.
+    T pushPop( T &&value )
+    {
+        return pushPopOp(std::move(value));
     }
 
     // O(log n). Insert an element and return a handle for it. No handles are
     // invalidated.
     Handle insert( const T & value )
     {
-        return insertOp(T(value));
+        return emplaceOp(value);
     }
 
     // O(log n). A version of insert which moves the element into the
     // underlying container instead of copying it.
     Handle insert( T && value )
     {
-        return insertOp(std::move(value));
+        return emplaceOp(std::move(value));
+    }
+
+    // O(k log n) for k elements in the range [first, last), but O(n + k) when
+    // the range is large, as the order is then restored bottom-up only in
+    // the subtrees with the new elements. No handles are invalidated.
+    template< typename Iterator >
+    void insert( Iterator first, Iterator last )
+    {
+        size_t oldSize = mHeapData.size();
+
+        try
+        {
+            appendRange(first, last);
+        }
+        catch(...)
+        {
+            restoreAppended(oldSize);
+            throw;
+        }
+
+        restoreAppended(oldSize);
+    }
+
+    // Same as above, also assigns handles of the new elements, in the order
+    // of the range, to the output iterator and returns it.
+    template< typename Iterator, typename OutputIterator >
+    OutputIterator insert( Iterator first, Iterator last, OutputIterator handles )
+    {
+        size_t oldSize = mHeapData.size();
+
+        try
+        {
+            appendRange(first, last);
+
+            for(size_t i = oldSize; i < mHeapData.size(); ++i)
+            {
+                *handles = getHandleAt(i);
+                ++handles;
+            }
+        }
+        catch(...)
+        {
+            restoreAppended(oldSize);
+            throw;
+        }
+
+        restoreAppended(oldSize);
+        return handles;
+    }
+
+    // O(log n). Construct an element in place from args and return a handle
+    // for it. No handles are invalidated.
+    template< typename... Args >
+    std::enable_if_t< std::is_constructible< T, Args&&... >::value, Handle >
+    emplace( Args &&... args )
+    {
+        return emplaceOp(std::forward<Args>(args)...);
+    }
+
+    // O(log n). A version of emplace for heaps of pairs (PriorityQueue), which
+    // constructs the second member in place from args.
+    template< typename P, typename... Args, typename U = T >
+    std::enable_if_t< IsPair< U >::value && !std::is_constructible< U, P&&, Args&&... >::value, Handle >
+    emplace( P &&priority, Args &&... args )
+    {
+        return emplaceOp(std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<P>(priority)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
     // O(1). Get value of an element represented by the given handle.
     // Precondition: h must be a valid handle for this.
     const T &get( const Handle &h ) const
     {
-        return getValAtPos(*h.mIter);
+        return getValAtPos(getPosOf(h));
+    }
+
+    // O(1). Does the handle refer to an element of this heap? Handles to
+    // erased elements and default constructed handles are never contained.
+    // The handle has to come from this heap or from a heap swapped or merged
+    // into it.
+    bool contains( const Handle &h ) const
+    {
+        return h.mSlot != nullptr && h.mSlot->mGeneration == h.mGeneration;
     }
 
     // O(log n). Update the value represented by the given handle (replace it
@@ -303,20 +1303,233 @@ public:
         updateOp(h, std::move(value));
     }
 
+    // O(log n). Modify the value represented by the given handle in place by
+    // calling fn on it, then restore the heap order. Unlike update, no new value
+    // is constructed or assigned, so fn can change a single field of a large
+    // element. If fn throws, the order is restored before the exception is
+    // propagated.
+    // Precondition: h must be a valid handle for this.
+    template< typename Fn >
+    void modify( const Handle &h, Fn &&fn )
+    {
+        if(empty()) { return; }
+
+        size_t pos = getPosOf(h);
+
+        try
+        {
+            std::forward<Fn>(fn)(mHeapData[pos].first);
+        }
+        catch(...)
+        {
+            restoreOrderAt(pos);
+            throw;
+        }
+
+        restoreOrderAt(pos);
+    }
+
+    // O(log n). Update the value represented by the given handle with a value
+    // that is not further from the top (e.g. not smaller for max-heap), which
+    // is the decrease-key of a min-heap. Only sifts towards the top.
+    // Precondition: h must be a valid handle for this and value must not be
+    // further from the top than the current value.
+    void promote( const Handle &h, const T &value )
+    {
+        if(empty()) { return; }
+
+        promoteOp(h, T(value));
+    }
+
+    // O(log n). A version of promote which uses move assign.
+    void promote( const Handle &h, T &&value )
+    {
+        if(empty()) { return; }
+
+        promoteOp(h, std::move(value));
+    }
+
+    // O(log n). Update the value represented by the given handle with a value
+    // that is not closer to the top. Only sifts towards the leaves.
+    // Precondition: h must be a valid handle for this and value must not be
+    // closer to the top than the current value.
+    void demote( const Handle &h, const T &value )
+    {
+        if(empty()) { return; }
+
+        demoteOp(h, T(value));
+    }
+
+    // O(log n). A version of demote which uses move assign.
+    void demote( const Handle &h, T &&value )
+    {
+        if(empty()) { return; }
+
+        demoteOp(h, std::move(value));
+    }
+
     // O(log n). Erase the value represented by the given handle from the heap.
     // Invalidates h, but does not invalidate handles to other elements.
     void erase( const Handle &h )
     {
         if(empty()) { return; }
 
-        unsigned position = *h.mIter;
+        eraseOp(h, HeapOperation::Erase);
+    }
 
-        swapElementsAtIndices(position, mHeapData.size()-1);
-        mValPos.erase(h.mIter);
-        mHeapData.erase(mHeapData.end()-1);
+    // O(log n). Remove the top element from the heap and return it. The value
+    // is moved out, so this works for move-only types.
+    // Precondition: the heap must not be empty.
+    T extractTop()
+    {
+        T result = std::move(mHeapData[0].first);
+        eraseOp(topHandle(), HeapOperation::Pop);
+        return result;
+    }
+
+    // O(log n). Erase the value represented by the given handle and return it.
+    // Invalidates h, but does not invalidate handles to other elements.
+    // Precondition: h must be a valid handle for this.
+    T extract( const Handle &h )
+    {
+        T result = std::move(mHeapData[getPosOf(h)].first);
+        eraseOp(h, HeapOperation::Erase);
+        return result;
+    }
+
+    // O(n). Erase all values for which pred returns true in a single pass and
+    // restore the order once. Invalidates handles to the erased values only.
+    // Returns the number of erased values. If pred throws, the values erased
+    // so far stay erased and the heap remains valid.
+    template< typename Pred >
+    size_t erase_if( Pred pred )
+    {
+        size_t oldSize = mHeapData.size();
+        size_t first = oldSize;
+
+        try
+        {
+            for(size_t i = 0; i < oldSize; ++i)
+            {
+                if(pred(getValAtPos(i)))
+                {
+                    releaseSlot(mHeapData[i].second);
+                    first = std::min(first, i);
+                }
+            }
+        }
+        catch(...)
+        {
+            compactFrom(first);
+            restoreAppended(first);
+            throw;
+        }
 
-        bubbleDown(position);
-        bubbleUp(position);
+        compactFrom(first);
+        restoreAppended(first);
+        return oldSize - mHeapData.size();
+    }
+
+    // O(n). Erase the values represented by the handles in the range [first,
+    // last) with a single pass over the heap. Invalid handles and duplicates
+    // are skipped. Returns the number of erased values.
+    template< typename HandleIterator >
+    size_t erase( HandleIterator first, HandleIterator last )
+    {
+        size_t oldSize = mHeapData.size();
+        size_t firstPos = oldSize;
+
+        for(; first != last; ++first)
+        {
+            const Handle &h = *first;
+            if(!contains(h)) { continue; }
+
+            size_t pos = getPosOf(h);
+            firstPos = std::min(firstPos, pos);
+            releaseSlot(mHeapData[pos].second);
+        }
+
+        compactFrom(firstPos);
+        restoreAppended(firstPos);
+        return oldSize - mHeapData.size();
+    }
+
+    // O(k log k). Assigns the k values closest to the top, in the order they
+    // would be popped in, to the output iterator and returns it. The heap is
+    // walked with a frontier heap of the indices whose parents were already
+    // output, so neither the heap nor its handles are touched.
+    template< typename OutputIterator >
+    OutputIterator topK( size_t k, OutputIterator o ) const
+    {
+        if(empty()) { return o; }
+
+        Compare compare = this->getCompare();
+        auto lowerIndex = [this, &compare](size_t lhs, size_t rhs)
+        {
+            return compare(getValAtPos(lhs), getValAtPos(rhs));
+        };
+
+        std::vector<size_t> frontier;
+        frontier.reserve(std::min(k * (Arity - 1) + 1, mHeapData.size()));
+        frontier.push_back(0);
+
+        for(; k > 0 && !frontier.empty(); --k)
+        {
+            std::pop_heap(frontier.begin(), frontier.end(), lowerIndex);
+            size_t index = frontier.back();
+            frontier.pop_back();
+
+            *o = getValAtPos(index);
+            ++o;
+
+            size_t child = getFirstChildOf(index);
+            size_t last = std::min(child + Arity, mHeapData.size());
+
+            for(; child < last; ++child)
+            {
+                frontier.push_back(child);
+                std::push_heap(frontier.begin(), frontier.end(), lowerIndex);
+            }
+        }
+
+        return o;
+    }
+
+    // O(n log n). Get the values in the order they would be popped in (top
+    // first). Only the values are copied and sorted, the heap and its handles
+    // are not touched. Large heaps with an empty comparator are sorted on
+    // all hardware threads, an explicit thread count is used for any heap
+    // and needs the comparator to be callable from more threads at once.
+    std::vector< T > sortedValues(BuildThreads threads = BuildThreads()) const &
+    {
+        std::vector<T> values;
+        values.reserve(mHeapData.size());
+
+        for(const auto& element : mHeapData)
+        {
+            values.push_back(element.first);
+        }
+
+        sortValues(values, threads.mCount);
+        return values;
+    }
+
+    // O(n log n). A version of sortedValues which moves the values out of the
+    // heap. The heap is left empty and all its handles become invalid.
+    std::vector< T > sortedValues(BuildThreads threads = BuildThreads()) &&
+    {
+        std::vector<T> values;
+        values.reserve(mHeapData.size());
+
+        for(auto& element : mHeapData)
+        {
+            values.push_back(std::move(element.first));
+            releaseSlot(element.second);
+        }
+
+        mHeapData.clear();
+        sortValues(values, threads.mCount);
+        return values;
     }
 
     // O(1). Get size (number of elements) of the heap.
@@ -334,29 +1547,47 @@ public:
 
 // O(n log n). Assigns values of the heap in the sorted order (top first) to the output
 // iterator. The complexity should hold if both increment and assignment to o
-// can be done in constant time.
-template< typename OutputIterator, typename T, typename Cmp >
-void copySorted( Heap< T, Cmp > heap, OutputIterator o )
+// can be done in constant time. The values are copied and sorted without
+// maintaining any handles, see Heap::sortedValues.
+template< typename OutputIterator, typename T, typename Cmp, size_t Arity, typename Stats >
+void copySorted( const Heap< T, Cmp, Arity, Stats > & heap, OutputIterator o )
 {
-    while(!heap.empty())
+    for(auto& value : heap.sortedValues())
     {
-        o = heap.top();
-        heap.pop();
+        *o = std::move(value);
+        ++o;
+    }
+}
+
+// O(n log n). A version of copySorted which moves the values out of the heap.
+template< typename OutputIterator, typename T, typename Cmp, size_t Arity, typename Stats >
+void copySorted( Heap< T, Cmp, Arity, Stats > && heap, OutputIterator o )
+{
+    for(auto& value : std::move(heap).sortedValues())
+    {
+        *o = std::move(value);
+        ++o;
     }
 }
 
 // O(n log n). Create sorted vector from the given heap.
-template< typename T, typename Cmp >
-std::vector< T > toSortedVector( Heap< T, Cmp > heap )
+template< typename T, typename Cmp, size_t Arity, typename Stats >
+std::vector< T > toSortedVector( const Heap< T, Cmp, Arity, Stats > & heap )
 {
-    std::vector<T> result;
-    copySorted(std::move(heap), std::back_inserter(result));
-    return result;
+    return heap.sortedValues();
+}
+
+// O(n log n). A version of toSortedVector which moves the values out of the
+// heap.
+template< typename T, typename Cmp, size_t Arity, typename Stats >
+std::vector< T > toSortedVector( Heap< T, Cmp, Arity, Stats > && heap )
+{
+    return std::move(heap).sortedValues();
 }
 
 // O(1). Swaps two heaps. See Heap::swap for more.
-template< typename T, typename Cmp >
-void swap( Heap< T, Cmp > & a, Heap< T, Cmp > & b ) { a.swap( b ); }
+template< typename T, typename Cmp, size_t Arity, typename Stats >
+void swap( Heap< T, Cmp, Arity, Stats > & a, Heap< T, Cmp, Arity, Stats > & b ) { a.swap( b ); }
 
 // examples of concrete heaps
 
@@ -367,9 +1598,13 @@ template< typename T >
 using MinHeap = Heap< T, std::greater< T > >;
 
 template< typename A, typename B, typename Cmp >
-struct PairCompare {
+struct PairCompare : private CompareStorage< Cmp > {
+    PairCompare() = default;
+
+    PairCompare( const Cmp & cmp ) : CompareStorage< Cmp >( cmp ) { }
+
     bool operator()( const std::pair< A, B > & a, const std::pair< A, B > & b ) const {
-        return Cmp()( a.first, b.first );
+        return this->getCompare()( a.first, b.first );
     }
 };
 
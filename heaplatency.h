@@ -0,0 +1,271 @@
+/*
+ * Latency histograms of Heap operations
+*/
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include "heap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef CPP14_HEAP_LATENCY
+#define CPP14_HEAP_LATENCY
+
+#if defined(__GNUC__)
+#define HEAP_LATENCY_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define HEAP_LATENCY_NOINLINE __declspec(noinline)
+#else
+#define HEAP_LATENCY_NOINLINE
+#endif
+
+/*
+Histogram of latencies with logarithmic buckets, in the way of HdrHistogram:
+every power of two is split into 16 linear buckets, so a recorded value is
+known to within 1/16 of itself, and values below 16 are exact. Values of 2^40
+and more share the last bucket, so there are b = 592 buckets. Recording is
+O(1) and takes no allocation.
+ */
+class LatencyHistogram
+{
+private:
+    static constexpr size_t SubBucketBits = 4;
+    static constexpr size_t SubBuckets = size_t(1) << SubBucketBits;
+    static constexpr size_t MaxBits = 40;
+    static constexpr size_t BucketCount = (MaxBits - SubBucketBits + 1) * SubBuckets;
+
+    std::vector<std::uint64_t> mBuckets;
+    std::uint64_t mCount = 0;
+    std::uint64_t mTotal = 0;
+    std::uint64_t mMax = 0;
+
+    static size_t getBucketOf(std::uint64_t value)
+    {
+        if(value < SubBuckets) { return static_cast<size_t>(value); }
+
+#if defined(__GNUC__)
+        size_t bits = std::numeric_limits<unsigned long long>::digits - 1 - __builtin_clzll(value);
+#else
+        size_t bits = 0;
+        for(std::uint64_t x = value >> 1; x != 0; x >>= 1) { ++bits; }
+#endif
+        if(bits >= MaxBits) { return BucketCount - 1; }
+
+        size_t shift = bits - SubBucketBits;
+        return (shift + 1) * SubBuckets + static_cast<size_t>((value >> shift) & (SubBuckets - 1));
+    }
+
+    // The largest value which falls into the bucket.
+    static std::uint64_t getUpperBoundOf(size_t bucket)
+    {
+        if(bucket < SubBuckets) { return bucket; }
+        if(bucket == BucketCount - 1) { return std::numeric_limits<std::uint64_t>::max(); }
+
+        size_t shift = bucket / SubBuckets - 1;
+        std::uint64_t low = std::uint64_t(SubBuckets + bucket % SubBuckets) << shift;
+        return low + (std::uint64_t(1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram()
+        :mBuckets(BucketCount) { }
+
+    // O(1).
+    void record(std::uint64_t value)
+    {
+        ++mBuckets[getBucketOf(value)];
+        ++mCount;
+        mTotal += value;
+        mMax = std::max(mMax, value);
+    }
+
+    // O(b) for b buckets. Adds the values recorded by other, e.g. of another
+    // heap.
+    void add(const LatencyHistogram& other)
+    {
+        for(size_t i = 0; i < BucketCount; ++i)
+        {
+            mBuckets[i] += other.mBuckets[i];
+        }
+
+        mCount += other.mCount;
+        mTotal += other.mTotal;
+        mMax = std::max(mMax, other.mMax);
+    }
+
+    // O(b). Forgets all recorded values.
+    void reset()
+    {
+        std::fill(mBuckets.begin(), mBuckets.end(), 0);
+        mCount = 0;
+        mTotal = 0;
+        mMax = 0;
+    }
+
+    // O(1). The number of recorded values.
+    std::uint64_t getCount() const
+    {
+        return mCount;
+    }
+
+    // O(1). The exact mean of the recorded values, zero if there are none.
+    double getMean() const
+    {
+        return mCount == 0 ? 0 : static_cast<double>(mTotal) / mCount;
+    }
+
+    // O(1). The exact largest recorded value.
+    std::uint64_t getMax() const
+    {
+        return mMax;
+    }
+
+    // O(b). The value below or at which the given fraction of the recorded
+    // values lies, e.g. 0.99 for the 99th percentile. It is the upper bound of
+    // the bucket the percentile falls into, but never more than the maximum.
+    std::uint64_t getPercentile(double fraction) const
+    {
+        if(mCount == 0) { return 0; }
+
+        std::uint64_t rank = static_cast<std::uint64_t>(fraction * mCount + 0.5);
+        rank = std::min(mCount, std::max<std::uint64_t>(1, rank));
+
+        std::uint64_t seen = 0;
+        size_t bucket = 0;
+
+        for(; bucket < BucketCount - 1; ++bucket)
+        {
+            seen += mBuckets[bucket];
+            if(seen >= rank) { break; }
+        }
+
+        return std::min(mMax, getUpperBoundOf(bucket));
+    }
+};
+
+// Tick source of HeapLatencyStats in nanoseconds of std::chrono::steady_clock.
+struct SteadyTicks
+{
+    static std::uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+// Tick source of HeapLatencyStats in cycles of the time stamp counter, which
+// is cheaper to read than the steady clock. The reads are not serialized, so
+// a latency may be off by a few dozen cycles.
+struct TscTicks
+{
+    static std::uint64_t now()
+    {
+        return __rdtsc();
+    }
+};
+#endif
+
+/*
+Statistics policy of Heap which records a LatencyHistogram of the ticks taken
+by every single insert (and emplace), pop (and extractTop), update (and
+promote, demote) and erase (and extract), e.g.
+
+    Heap< Job, JobCompare, 2, HeapLatencyStats<> > heap;
+    heap.stats().setSampleInterval( 64 );
+    ...
+    heap.stats().writePercentiles( std::cerr );
+
+Only every sample interval-th operation reads the clock twice, the others pay
+one decrement, so sampling keeps the overhead low enough to be left on. The
+hooks of the operation counters are left empty, see HeapStats.
+ */
+template< typename Ticks = SteadyTicks >
+class HeapLatencyStats : public NoHeapStats
+{
+private:
+    static constexpr size_t OperationCount = 4;
+
+    LatencyHistogram mHistograms[OperationCount];
+    std::uint32_t mSampleInterval = 1;
+    std::uint32_t mCountdown = 1;
+
+    // The sampled path is kept out of line, inlined into every operation it
+    // stops the sifts from being inlined, which costs more than the clock.
+    HEAP_LATENCY_NOINLINE std::uint64_t startSample()
+    {
+        mCountdown = mSampleInterval;
+        return Ticks::now();
+    }
+
+    HEAP_LATENCY_NOINLINE void finishSample(HeapOperation operation, std::uint64_t start)
+    {
+        mHistograms[static_cast<size_t>(operation)].record(Ticks::now() - start);
+    }
+
+public:
+    // O(1). Returns the start tick of a sampled operation, zero otherwise.
+    std::uint64_t startOperation()
+    {
+        if(--mCountdown != 0) { return 0; }
+
+        return startSample();
+    }
+
+    // O(1).
+    void finishOperation(HeapOperation operation, std::uint64_t start)
+    {
+        if(start != 0) { finishSample(operation, start); }
+    }
+
+    // O(1). Time only every interval-th operation, the default is every one.
+    void setSampleInterval(std::uint32_t interval)
+    {
+        mSampleInterval = std::max<std::uint32_t>(1, interval);
+        mCountdown = mSampleInterval;
+    }
+
+    // O(1).
+    const LatencyHistogram& getHistogram(HeapOperation operation) const
+    {
+        return mHistograms[static_cast<size_t>(operation)];
+    }
+
+    // O(b). Forgets all recorded latencies.
+    void reset()
+    {
+        for(auto& histogram : mHistograms)
+        {
+            histogram.reset();
+        }
+    }
+
+    // O(b). Writes the count, mean, median, 90th, 99th and 99.9th percentile
+    // and maximum of every operation in ticks, as one JSON object.
+    void writePercentiles(std::ostream& out) const
+    {
+        static const char* const names[OperationCount] = { "insert", "pop", "update", "erase" };
+
+        out << "{";
+
+        for(size_t i = 0; i < OperationCount; ++i)
+        {
+            const LatencyHistogram& h = mHistograms[i];
+
+            out << (i == 0 ? " \"" : ", \"") << names[i] << "\": { \"count\": " << h.getCount()
+                << ", \"mean\": " << h.getMean() << ", \"p50\": " << h.getPercentile(0.5)
+                << ", \"p90\": " << h.getPercentile(0.9) << ", \"p99\": " << h.getPercentile(0.99)
+                << ", \"p999\": " << h.getPercentile(0.999) << ", \"max\": " << h.getMax() << " }";
+        }
+
+        out << " }";
+    }
+};
+
+#endif // CPP14_HEAP_LATENCY
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
 #include "heap.h"
 #include "catch.hpp"
 
@@ -9,6 +12,7 @@
 
 // Test that all Heap functions instantiate at least for int.
 template class Heap< int, std::less< int > >;
+template class Heap< int, std::less< int >, 4 >;
 
 TEST_CASE( "Empty heap" ) {
     MaxHeap< int > h;
@@ -156,6 +160,60 @@ TEST_CASE( "Update random" ) {
     REQUIRE( random == toSortedVector( heap ) );
 }
 
+TEST_CASE( "Promote and demote" ) {
+    std::vector< int > random( 1024 * 16 );
+    std::mt19937 randgen;
+    std::generate( random.begin(), random.end(), randgen );
+    MaxHeap< int > heap;
+    std::vector< MaxHeap< int >::Handle > handles;
+
+    for ( int x : random )
+        handles.push_back( heap.insert( x ) );
+
+    for ( size_t i = 0; i < random.size(); i += 3 ) {
+        if ( i % 2 ) {
+            heap.promote( handles[ i ], random[ i ] = random[ i ] / 2 + 1073741823 );
+        } else {
+            heap.demote( handles[ i ], random[ i ] = random[ i ] / 2 - 1073741824 );
+        }
+        REQUIRE( heap.get( handles[ i ] ) == random[ i ] );
+    }
+
+    std::sort( random.begin(), random.end(), gt );
+    REQUIRE( random == toSortedVector( heap ) );
+}
+
+TEST_CASE( "Replace top" ) {
+    MinHeap< int > heap = { 5, 3, 8, 1 };
+    auto h = heap.topHandle();
+
+    SECTION( "replaceTop" ) {
+        REQUIRE( heap.replaceTop( 6 ) == h );
+        REQUIRE( heap.top() == 3 );
+        REQUIRE( heap.get( h ) == 6 );
+        REQUIRE( heap.size() == 4 );
+        REQUIRE( toSortedVector( heap ) == std::vector< int >( { 3, 5, 6, 8 } ) );
+    }
+    SECTION( "pushPop bigger" ) {
+        REQUIRE( heap.pushPop( 4 ) == 1 );
+        REQUIRE( heap.get( h ) == 4 );
+        REQUIRE( heap.top() == 3 );
+        REQUIRE( toSortedVector( heap ) == std::vector< int >( { 3, 4, 5, 8 } ) );
+    }
+    SECTION( "pushPop smaller" ) {
+        REQUIRE( heap.pushPop( 0 ) == 0 );
+        REQUIRE( heap.topHandle() == h );
+        REQUIRE( heap.size() == 4 );
+    }
+    SECTION( "empty heap" ) {
+        MinHeap< int > empty;
+        REQUIRE( empty.pushPop( 2 ) == 2 );
+        REQUIRE( empty.empty() );
+        auto h2 = empty.replaceTop( 2 );
+        REQUIRE( empty.topHandle() == h2 );
+    }
+}
+
 TEST_CASE( "Erase" ) {
     MaxHeap< int > heap;
     auto h = heap.insert( 1 );
@@ -0,0 +1,156 @@
+/*
+ * Relaxed concurrent priority queue made of many sequential heaps
+*/
+#include <functional> // less, hash
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <random>
+#include "heap.h"
+
+#ifndef CPP14_MULTI_QUEUE
+#define CPP14_MULTI_QUEUE
+
+/*
+MultiQueue of Rihani, Sanders and Dementiev: c * p sequential Heaps, each
+behind its own lock, for p threads. Insert puts the element into a random
+queue, pop looks at two random queues and removes the better of their tops.
+Locks are only tried, a thread which does not get a lock picks other queues,
+so threads rarely wait for each other.
+
+The order is relaxed: pop returns an element close to the top, not
+necessarily the top, the expected rank of the popped element is O(c * p).
+With a single queue it is an exact, mutex-guarded Heap. There are no handles,
+elements can only be inserted and popped.
+ */
+template< typename T, typename Compare >
+class MultiQueue
+{
+private:
+    struct Queue
+    {
+        std::mutex mLock;
+        Heap<T, Compare> mHeap;
+        // keeps the locks of neighbouring queues out of one cache line
+        char mPadding[64];
+    };
+
+    std::vector<Queue> mQueues;
+    std::atomic<size_t> mSize { 0 };
+
+    size_t getRandomQueue() const
+    {
+        thread_local std::minstd_rand randgen(
+            static_cast<std::minstd_rand::result_type>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+        return randgen() % mQueues.size();
+    }
+
+    template< typename U >
+    void insertOp(U&& value)
+    {
+        for(;;)
+        {
+            Queue& queue = mQueues[getRandomQueue()];
+            std::unique_lock<std::mutex> lock(queue.mLock, std::try_to_lock);
+
+            if(lock.owns_lock())
+            {
+                queue.mHeap.insert(std::forward<U>(value));
+                mSize.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+public:
+    using value_type = T;
+    using value_compare = Compare;
+
+    // O(c * p). The default is c = 2 queues per thread of the machine.
+    explicit MultiQueue( size_t threadCount = std::thread::hardware_concurrency(), size_t queuesPerThread = 2,
+                         const Compare & compare = Compare() )
+        :mQueues(std::max<size_t>(1, threadCount * queuesPerThread))
+    {
+        for(auto& queue : mQueues)
+        {
+            queue.mHeap = Heap<T, Compare>(compare);
+        }
+    }
+
+    MultiQueue( const MultiQueue & ) = delete;
+
+    MultiQueue &operator=( const MultiQueue & ) = delete;
+
+    // O(log n). Insert the element into a random queue.
+    void insert( const T & value )
+    {
+        insertOp(value);
+    }
+
+    // O(log n). A version of insert which moves the element.
+    void insert( T && value )
+    {
+        insertOp(std::move(value));
+    }
+
+    // O(log n). Remove an element close to the top and move it to result.
+    // Returns false if the queue was empty.
+    bool pop( T &result )
+    {
+        while(mSize.load(std::memory_order_relaxed) != 0)
+        {
+            size_t first = getRandomQueue();
+            size_t second = getRandomQueue();
+
+            std::unique_lock<std::mutex> firstLock(mQueues[first].mLock, std::try_to_lock);
+            if(!firstLock.owns_lock()) { continue; }
+
+            std::unique_lock<std::mutex> secondLock;
+            if(second != first)
+            {
+                secondLock = std::unique_lock<std::mutex>(mQueues[second].mLock, std::try_to_lock);
+                if(!secondLock.owns_lock()) { continue; }
+            }
+
+            Heap<T, Compare>* heap = &mQueues[first].mHeap;
+            Heap<T, Compare>* other = &mQueues[second].mHeap;
+
+            if(heap->empty() || (!other->empty() && heap->value_comp()(heap->top(), other->top())))
+            {
+                heap = other;
+            }
+
+            if(heap->empty()) { continue; }
+
+            result = heap->extractTop();
+            mSize.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    // O(1). The number of queues.
+    size_t queueCount() const
+    {
+        return mQueues.size();
+    }
+
+    // O(1).
+    size_t size() const
+    {
+        return mSize.load(std::memory_order_relaxed);
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return size() == 0;
+    }
+};
+
+#endif // CPP14_MULTI_QUEUE
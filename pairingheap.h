@@ -0,0 +1,532 @@
+/*
+ * Pairing heap with support for modification
+*/
+#include <functional> // less
+#include <initializer_list>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+#include <new>
+#include "heap.h"
+
+#ifndef CPP14_PAIRING_HEAP
+#define CPP14_PAIRING_HEAP
+
+/*
+Pairing heap <https://en.wikipedia.org/wiki/Pairing_heap> with the same
+interface as Heap, so the two can be swapped for each other. Insert, promote
+(decrease-key for a min-heap) and top are O(1), pop, erase and demote are
+O(log n) amortized. This makes it a better fit than the array based Heap when
+most of the operations are key improvements, e.g. in Dijkstra's algorithm.
+
+Each node is a separate tree node linked to its first child, next sibling and
+previous sibling (or parent for the first child). The nodes are allocated in
+blocks that are never moved or freed until the heap is destructed, and erased
+nodes are reused through a free list, so an insert allocates only once per
+block. Handles point directly to the nodes and, like in Heap, carry the
+generation of the node, so handles to erased values are recognized.
+ */
+template< typename T, typename Compare >
+class PairingHeap : private CompareStorage< Compare >
+{
+    using CompareBase = CompareStorage< Compare >;
+
+public:
+    struct Handle;
+
+private:
+    static constexpr size_t BlockSize = 1024;
+
+    struct Node
+    {
+        Node* mChild;
+        Node* mNext;
+        Node* mPrev; // previous sibling, or parent of the first child
+        std::uint32_t mGeneration; // odd while the node holds a value
+        typename std::aligned_storage< sizeof(T), alignof(T) >::type mStorage;
+    };
+
+    std::vector<std::unique_ptr<Node[]>> mBlocks;
+    size_t mUsedInLastBlock = BlockSize;
+    Node* mFreeNode = nullptr;
+    Node* mRoot = nullptr;
+    size_t mSize = 0;
+
+    static T& valueOf(Node* node)
+    {
+        return *reinterpret_cast<T*>(&node->mStorage);
+    }
+
+    bool compare(const T& lhs, const T& rhs)
+    {
+        return this->getCompare()(lhs, rhs);
+    }
+
+    template< typename... Args >
+    Node* createNode(Args&&... args)
+    {
+        Node* node = mFreeNode;
+
+        if(node != nullptr)
+        {
+            mFreeNode = node->mNext;
+        }
+        else
+        {
+            if(mUsedInLastBlock == BlockSize)
+            {
+                mBlocks.emplace_back(new Node[BlockSize]());
+                mUsedInLastBlock = 0;
+            }
+
+            node = &mBlocks.back()[mUsedInLastBlock++];
+        }
+
+        try
+        {
+            ::new (static_cast<void*>(&node->mStorage)) T(std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            node->mNext = mFreeNode;
+            mFreeNode = node;
+            throw;
+        }
+
+        node->mChild = node->mNext = node->mPrev = nullptr;
+        ++node->mGeneration;
+        ++mSize;
+
+        return node;
+    }
+
+    void destroyNode(Node* node)
+    {
+        valueOf(node).~T();
+        ++node->mGeneration;
+        --mSize;
+
+        node->mNext = mFreeNode;
+        mFreeNode = node;
+    }
+
+    // Links two roots, the one further from the top becomes the first child
+    // of the other. Returns the new root.
+    Node* meld(Node* first, Node* second)
+    {
+        if(first == nullptr) { return second; }
+        if(second == nullptr) { return first; }
+
+        if(compare(valueOf(first), valueOf(second))) { std::swap(first, second); }
+
+        second->mNext = first->mChild;
+        if(first->mChild != nullptr) { first->mChild->mPrev = second; }
+        second->mPrev = first;
+        first->mChild = second;
+
+        return first;
+    }
+
+    // Detaches the subtree of a non-root node from its parent and siblings.
+    void cut(Node* node)
+    {
+        if(node->mPrev->mChild == node) { node->mPrev->mChild = node->mNext; }
+        else { node->mPrev->mNext = node->mNext; }
+
+        if(node->mNext != nullptr) { node->mNext->mPrev = node->mPrev; }
+
+        node->mNext = node->mPrev = nullptr;
+    }
+
+    // Standard two-pass merge of the sibling list starting at first: melds
+    // pairs left to right, then the results right to left. Iterative, so long
+    // sibling lists do not exhaust the stack.
+    Node* mergePairs(Node* first)
+    {
+        Node* pairs = nullptr;
+
+        while(first != nullptr)
+        {
+            Node* a = first;
+            Node* b = a->mNext;
+            first = b != nullptr ? b->mNext : nullptr;
+
+            a->mNext = a->mPrev = nullptr;
+            if(b != nullptr) { b->mNext = b->mPrev = nullptr; }
+
+            Node* melded = meld(a, b);
+            melded->mNext = pairs;
+            pairs = melded;
+        }
+
+        Node* result = nullptr;
+
+        while(pairs != nullptr)
+        {
+            Node* next = pairs->mNext;
+            pairs->mNext = nullptr;
+            result = meld(result, pairs);
+            pairs = next;
+        }
+
+        return result;
+    }
+
+    // Removes the node from the tree, its children are merged back.
+    void unlink(Node* node)
+    {
+        Node* children = mergePairs(node->mChild);
+        node->mChild = nullptr;
+
+        if(node == mRoot)
+        {
+            mRoot = children;
+        }
+        else
+        {
+            cut(node);
+            mRoot = meld(mRoot, children);
+        }
+    }
+
+    void promoteNode(Node* node)
+    {
+        if(node == mRoot) { return; }
+
+        cut(node);
+        mRoot = meld(mRoot, node);
+    }
+
+    void demoteNode(Node* node)
+    {
+        unlink(node);
+        mRoot = meld(mRoot, node);
+    }
+
+    void updateOp(const Handle& h, T&& value)
+    {
+        bool moveUp = compare(valueOf(h.mNode), value);
+        valueOf(h.mNode) = std::move(value);
+
+        if(moveUp) { promoteNode(h.mNode); }
+        else { demoteNode(h.mNode); }
+    }
+
+    void clear()
+    {
+        for(size_t i = 0; i < mBlocks.size(); ++i)
+        {
+            size_t used = i + 1 == mBlocks.size() ? mUsedInLastBlock : BlockSize;
+
+            for(size_t j = 0; j < used; ++j)
+            {
+                if(mBlocks[i][j].mGeneration % 2 == 1) { valueOf(&mBlocks[i][j]).~T(); }
+            }
+        }
+
+        mBlocks.clear();
+        mUsedInLastBlock = BlockSize;
+        mFreeNode = mRoot = nullptr;
+        mSize = 0;
+    }
+
+public:
+    using value_type = T;
+    using value_compare = Compare;
+
+    // Same requirements as Heap::Handle.
+    struct Handle
+    {
+    private:
+        Node* mNode = nullptr;
+        std::uint32_t mGeneration = 0;
+
+        Handle(Node* node)
+            :mNode(node), mGeneration(node->mGeneration) { }
+
+    public:
+        Handle() = default;
+
+        Handle(const Handle&) = default;
+
+        Handle(Handle&&) noexcept = default;
+
+        Handle& operator=(const Handle&) = default;
+
+        Handle& operator=(Handle&&) noexcept = default;
+
+        bool operator==(const Handle &o) const
+        {
+            return mNode == o.mNode && mGeneration == o.mGeneration;
+        }
+
+        bool operator!=(const Handle &o) const
+        {
+            return !(*this == o);
+        }
+
+        friend class PairingHeap;
+    };
+
+    // O(1).
+    PairingHeap() = default;
+
+    // O(1). Create an empty heap ordered by the given comparator.
+    explicit PairingHeap( const Compare & compare )
+        :CompareBase(compare) { }
+
+    // O(n). The handles from other should not be used with this. Delegates to
+    // the comparator constructor, so the destructor frees the elements
+    // inserted so far if a copy throws.
+    PairingHeap( const PairingHeap & other )
+        :PairingHeap(other.getCompare())
+    {
+        std::vector<Node*> stack;
+        if(other.mRoot != nullptr) { stack.push_back(other.mRoot); }
+
+        while(!stack.empty())
+        {
+            Node* node = stack.back();
+            stack.pop_back();
+
+            insert(valueOf(node));
+
+            if(node->mChild != nullptr) { stack.push_back(node->mChild); }
+            if(node->mNext != nullptr) { stack.push_back(node->mNext); }
+        }
+    }
+
+    // O(1). All handles for other are valid handles for this.
+    PairingHeap( PairingHeap && other ) noexcept(std::is_nothrow_copy_constructible< Compare >::value)
+        :CompareBase(other.getCompare()),
+         mBlocks(std::move(other.mBlocks)),
+         mUsedInLastBlock(other.mUsedInLastBlock),
+         mFreeNode(other.mFreeNode),
+         mRoot(other.mRoot),
+         mSize(other.mSize)
+    {
+        other.mBlocks.clear();
+        other.mUsedInLastBlock = BlockSize;
+        other.mFreeNode = other.mRoot = nullptr;
+        other.mSize = 0;
+    }
+
+    // O(n) where n is the distance from begin to end.
+    template< typename Iterator >
+    PairingHeap( Iterator begin, Iterator end, const Compare & compare = Compare() )
+        :PairingHeap(compare)
+    {
+        for(; begin != end; ++begin)
+        {
+            insert(*begin);
+        }
+    }
+
+    // O(n) where n is the number of elements in list.
+    PairingHeap( std::initializer_list< T > list, const Compare & compare = Compare() )
+        :PairingHeap(list.begin(), list.end(), compare) { }
+
+    // O(n). Same as the copy constructor.
+    PairingHeap &operator=( PairingHeap other )
+    {
+        swap(other);
+        return *this;
+    }
+
+    // O(n). Invalidates all handles to this.
+    ~PairingHeap()
+    {
+        clear();
+    }
+
+    // O(1). After the swap all handles for this are valid handles for other
+    // and vice versa.
+    void swap( PairingHeap &other )
+    {
+        using std::swap;
+        swap(this->getCompare(), other.getCompare());
+        swap(mBlocks, other.mBlocks);
+        swap(mUsedInLastBlock, other.mUsedInLastBlock);
+        swap(mFreeNode, other.mFreeNode);
+        swap(mRoot, other.mRoot);
+        swap(mSize, other.mSize);
+    }
+
+    // O(1). Get the comparator the heap is ordered by.
+    Compare value_comp() const
+    {
+        return this->getCompare();
+    }
+
+    // O(1).
+    const T &top() const
+    {
+        return valueOf(mRoot);
+    }
+
+    // O(1).
+    Handle topHandle() const
+    {
+        return Handle(mRoot);
+    }
+
+    // O(log n) amortized.
+    void pop()
+    {
+        if(!empty()) { erase(topHandle()); }
+    }
+
+    // O(log n) amortized. Precondition: the heap must not be empty.
+    T extractTop()
+    {
+        return extract(topHandle());
+    }
+
+    // O(1).
+    Handle insert( const T & value )
+    {
+        return emplace(value);
+    }
+
+    // O(1).
+    Handle insert( T && value )
+    {
+        return emplace(std::move(value));
+    }
+
+    // O(1). Construct an element in place from args.
+    template< typename... Args >
+    Handle emplace( Args &&... args )
+    {
+        Node* node = createNode(std::forward<Args>(args)...);
+        mRoot = meld(mRoot, node);
+
+        return Handle(node);
+    }
+
+    // O(1). Precondition: h must be a valid handle for this.
+    const T &get( const Handle &h ) const
+    {
+        return valueOf(h.mNode);
+    }
+
+    // O(1). Does the handle still refer to an element? Precondition: h must be
+    // a default constructed handle or a handle obtained from this.
+    bool contains( const Handle &h ) const
+    {
+        return h.mNode != nullptr && h.mNode->mGeneration == h.mGeneration;
+    }
+
+    // O(1) if the value moves towards the top, O(log n) amortized otherwise.
+    // Precondition: h must be a valid handle for this.
+    void update( const Handle &h, const T &value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, T(value));
+    }
+
+    // A version of update which uses move assign.
+    void update( const Handle &h, T &&value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, std::move(value));
+    }
+
+    // O(1). Same as Heap::promote, the value must not move away from the top.
+    void promote( const Handle &h, const T &value )
+    {
+        promote(h, T(value));
+    }
+
+    // O(1). A version of promote which uses move assign.
+    void promote( const Handle &h, T &&value )
+    {
+        if(empty()) { return; }
+
+        valueOf(h.mNode) = std::move(value);
+        promoteNode(h.mNode);
+    }
+
+    // O(log n) amortized. Same as Heap::demote.
+    void demote( const Handle &h, const T &value )
+    {
+        demote(h, T(value));
+    }
+
+    // O(log n) amortized. A version of demote which uses move assign.
+    void demote( const Handle &h, T &&value )
+    {
+        if(empty()) { return; }
+
+        valueOf(h.mNode) = std::move(value);
+        demoteNode(h.mNode);
+    }
+
+    // O(log n) amortized. Invalidates h only.
+    void erase( const Handle &h )
+    {
+        if(empty()) { return; }
+
+        unlink(h.mNode);
+        destroyNode(h.mNode);
+    }
+
+    // O(log n) amortized. Erase the value and return it.
+    // Precondition: h must be a valid handle for this.
+    T extract( const Handle &h )
+    {
+        T result = std::move(valueOf(h.mNode));
+        erase(h);
+        return result;
+    }
+
+    // O(1).
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+};
+
+// O(n log n). Same as copySorted for Heap.
+template< typename OutputIterator, typename T, typename Cmp >
+void copySorted( PairingHeap< T, Cmp > heap, OutputIterator o )
+{
+    while(!heap.empty())
+    {
+        *o = heap.extractTop();
+        ++o;
+    }
+}
+
+// O(n log n). Create sorted vector from the given heap.
+template< typename T, typename Cmp >
+std::vector< T > toSortedVector( PairingHeap< T, Cmp > heap )
+{
+    std::vector<T> result;
+    result.reserve(heap.size());
+    copySorted(std::move(heap), std::back_inserter(result));
+    return result;
+}
+
+// O(1). Swaps two heaps. See PairingHeap::swap for more.
+template< typename T, typename Cmp >
+void swap( PairingHeap< T, Cmp > & a, PairingHeap< T, Cmp > & b ) { a.swap( b ); }
+
+template< typename T >
+using MaxPairingHeap = PairingHeap< T, std::less< T > >;
+
+template< typename T >
+using MinPairingHeap = PairingHeap< T, std::greater< T > >;
+
+#endif // CPP14_PAIRING_HEAP
@@ -0,0 +1,403 @@
+/*
+ * Radix heap for monotone integer priorities
+*/
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <cassert>
+
+#ifndef CPP14_RADIX_HEAP
+#define CPP14_RADIX_HEAP
+
+/*
+Radix heap <https://en.wikipedia.org/wiki/Radix_heap> of (key, value) pairs
+with unsigned integer keys and the interface of a min-ordered PriorityQueue.
+It requires the keys to be monotone: a key inserted or updated must not be
+smaller than the key of the last popped element. In exchange, the elements are
+kept in buckets by the highest bit in which their key differs from the last
+popped key, so insert and update are O(1) and pop is O(log C) amortized, where
+C is the range of the keys, with almost no comparisons.
+
+Builds without NDEBUG assert that keys are monotone. Handles work the same way
+as the handles of Heap.
+ */
+template< typename Key, typename Value >
+class RadixHeap
+{
+    static_assert(std::is_integral< Key >::value && std::is_unsigned< Key >::value,
+                  "RadixHeap needs an unsigned integer key");
+
+public:
+    struct Handle;
+    using value_type = std::pair< Key, Value >;
+
+private:
+    using SlotId = std::uint32_t;
+
+    static constexpr SlotId InvalidSlot = std::numeric_limits<SlotId>::max();
+    static constexpr size_t BucketCount = std::numeric_limits<Key>::digits + 1;
+
+    // Same as Heap::Slot, the position is a bucket and an index within it.
+    struct Slot
+    {
+        SlotId mPos;
+        std::uint32_t mGeneration;
+        std::uint32_t mBucket;
+    };
+
+    using Entry = std::pair< value_type, SlotId >;
+
+    std::vector<Entry> mBuckets[BucketCount];
+    std::vector<Slot> mSlots;
+    SlotId mFreeSlot = InvalidSlot;
+    Key mLast = 0;
+    size_t mSize = 0;
+
+    // The position of the top element, found lazily by top() and kept until
+    // the next change of the heap.
+    mutable size_t mTopBucket = 0;
+    mutable size_t mTopPos = 0;
+    mutable bool mTopValid = false;
+
+    static size_t getBitWidth(unsigned long long x)
+    {
+#if defined(__GNUC__)
+        return x == 0 ? 0 : std::numeric_limits<unsigned long long>::digits - __builtin_clzll(x);
+#else
+        size_t width = 0;
+        for(; x != 0; x >>= 1) { ++width; }
+        return width;
+#endif
+    }
+
+    size_t getBucketOf(Key key) const
+    {
+        return getBitWidth(static_cast<unsigned long long>(key ^ mLast));
+    }
+
+    SlotId acquireSlot()
+    {
+        SlotId slot = mFreeSlot;
+
+        if(slot != InvalidSlot)
+        {
+            mFreeSlot = mSlots[slot].mPos;
+        }
+        else
+        {
+            slot = static_cast<SlotId>(mSlots.size());
+            mSlots.push_back(Slot{ 0, 0, 0 });
+        }
+
+        ++mSlots[slot].mGeneration;
+        return slot;
+    }
+
+    void releaseSlot(SlotId slot)
+    {
+        mSlots[slot].mPos = mFreeSlot;
+        ++mSlots[slot].mGeneration;
+        mFreeSlot = slot;
+    }
+
+    void placeEntry(Entry&& entry)
+    {
+        size_t bucket = getBucketOf(entry.first.first);
+
+        mSlots[entry.second].mBucket = static_cast<std::uint32_t>(bucket);
+        mSlots[entry.second].mPos = static_cast<SlotId>(mBuckets[bucket].size());
+        mBuckets[bucket].push_back(std::move(entry));
+    }
+
+    Entry removeEntry(size_t bucket, size_t pos)
+    {
+        std::vector<Entry>& entries = mBuckets[bucket];
+        Entry result = std::move(entries[pos]);
+
+        if(pos + 1 != entries.size())
+        {
+            entries[pos] = std::move(entries.back());
+            mSlots[entries[pos].second].mPos = static_cast<SlotId>(pos);
+        }
+        entries.pop_back();
+
+        return result;
+    }
+
+    void findTop() const
+    {
+        if(mTopValid) { return; }
+
+        size_t bucket = 0;
+        while(mBuckets[bucket].empty()) { ++bucket; }
+
+        const std::vector<Entry>& entries = mBuckets[bucket];
+        size_t pos = 0;
+
+        if(bucket != 0)
+        {
+            for(size_t i = 1; i < entries.size(); ++i)
+            {
+                if(entries[i].first.first < entries[pos].first.first) { pos = i; }
+            }
+        }
+
+        mTopBucket = bucket;
+        mTopPos = pos;
+        mTopValid = true;
+    }
+
+    // Makes the top element the last popped key and moves the elements of its
+    // bucket to lower buckets, which leaves the top element in bucket 0.
+    void pullTop()
+    {
+        findTop();
+        if(mTopBucket == 0) { return; }
+
+        std::vector<Entry> entries;
+        entries.swap(mBuckets[mTopBucket]);
+        mLast = entries[mTopPos].first.first;
+        SlotId topSlot = entries[mTopPos].second;
+
+        for(auto& entry : entries)
+        {
+            placeEntry(std::move(entry));
+        }
+
+        // keep the capacity of the emptied bucket for later
+        entries.clear();
+        mBuckets[mTopBucket].swap(entries);
+
+        // other elements with the same key land in bucket 0 too, so keep
+        // the one that top() reported
+        mTopBucket = 0;
+        mTopPos = mSlots[topSlot].mPos;
+    }
+
+    void updateOp(const Handle& h, value_type&& value)
+    {
+        assert(value.first >= mLast && "RadixHeap: key smaller than the last popped key");
+
+        Slot& slot = mSlots[h.mSlot];
+        Entry entry = removeEntry(slot.mBucket, slot.mPos);
+        entry.first = std::move(value);
+        placeEntry(std::move(entry));
+
+        mTopValid = false;
+    }
+
+public:
+    // Same requirements as Heap::Handle.
+    struct Handle
+    {
+    private:
+        SlotId mSlot = InvalidSlot;
+        std::uint32_t mGeneration = 0;
+
+        Handle(SlotId slot, std::uint32_t generation)
+            :mSlot(slot), mGeneration(generation) { }
+
+    public:
+        Handle() = default;
+
+        Handle(const Handle&) = default;
+
+        Handle(Handle&&) noexcept = default;
+
+        Handle& operator=(const Handle&) = default;
+
+        Handle& operator=(Handle&&) noexcept = default;
+
+        bool operator==(const Handle &o) const
+        {
+            return mSlot == o.mSlot && mGeneration == o.mGeneration;
+        }
+
+        bool operator!=(const Handle &o) const
+        {
+            return !(*this == o);
+        }
+
+        friend class RadixHeap;
+    };
+
+    // O(1).
+    RadixHeap() = default;
+
+    // O(n). The handles from other should not be used with this.
+    RadixHeap( const RadixHeap & other ) = default;
+
+    // O(1). All handles for other are valid handles for this.
+    RadixHeap( RadixHeap && other ) noexcept : RadixHeap()
+    {
+        swap(other);
+    }
+
+    // O(n).
+    RadixHeap &operator=( RadixHeap other )
+    {
+        swap(other);
+        return *this;
+    }
+
+    // O(1). After the swap all handles for this are valid handles for other
+    // and vice versa.
+    void swap( RadixHeap &other )
+    {
+        using std::swap;
+        for(size_t i = 0; i < BucketCount; ++i)
+        {
+            swap(mBuckets[i], other.mBuckets[i]);
+        }
+        swap(mSlots, other.mSlots);
+        swap(mFreeSlot, other.mFreeSlot);
+        swap(mLast, other.mLast);
+        swap(mSize, other.mSize);
+        swap(mTopBucket, other.mTopBucket);
+        swap(mTopPos, other.mTopPos);
+        swap(mTopValid, other.mTopValid);
+    }
+
+    // O(1) amortized. Get the element with the smallest key.
+    const value_type &top() const
+    {
+        findTop();
+        return mBuckets[mTopBucket][mTopPos].first;
+    }
+
+    // O(1) amortized.
+    Handle topHandle() const
+    {
+        findTop();
+        SlotId slot = mBuckets[mTopBucket][mTopPos].second;
+        return Handle(slot, mSlots[slot].mGeneration);
+    }
+
+    // O(log C) amortized. The key of the popped element becomes the lower
+    // bound for the keys inserted from now on.
+    void pop()
+    {
+        if(empty()) { return; }
+
+        pullTop();
+        releaseSlot(removeEntry(0, mTopPos).second);
+        --mSize;
+        mTopValid = false;
+    }
+
+    // O(1). Precondition: value.first must not be smaller than the key of the
+    // last popped element.
+    Handle insert( const value_type & value )
+    {
+        return insert(value_type(value));
+    }
+
+    // O(1). A version of insert which moves the element.
+    Handle insert( value_type && value )
+    {
+        assert(value.first >= mLast && "RadixHeap: key smaller than the last popped key");
+
+        if(mTopValid && value.first < top().first) { mTopValid = false; }
+
+        SlotId slot = acquireSlot();
+
+        try
+        {
+            placeEntry(Entry(std::move(value), slot));
+        }
+        catch(...)
+        {
+            releaseSlot(slot);
+            throw;
+        }
+
+        ++mSize;
+        return Handle(slot, mSlots[slot].mGeneration);
+    }
+
+    // O(1). Precondition: h must be a valid handle for this.
+    const value_type &get( const Handle &h ) const
+    {
+        const Slot& slot = mSlots[h.mSlot];
+        return mBuckets[slot.mBucket][slot.mPos].first;
+    }
+
+    // O(1). Does the handle refer to an element of this heap?
+    bool contains( const Handle &h ) const
+    {
+        return h.mSlot < mSlots.size() && mSlots[h.mSlot].mGeneration == h.mGeneration;
+    }
+
+    // O(1). Update the element represented by the given handle, typically as
+    // a decrease-key. Precondition: h must be a valid handle for this and
+    // value.first must not be smaller than the key of the last popped element.
+    void update( const Handle &h, const value_type &value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, value_type(value));
+    }
+
+    // O(1). A version of update which moves the element.
+    void update( const Handle &h, value_type &&value )
+    {
+        if(empty()) { return; }
+
+        updateOp(h, std::move(value));
+    }
+
+    // O(1). Erase the element represented by the given handle.
+    void erase( const Handle &h )
+    {
+        if(empty()) { return; }
+
+        const Slot& slot = mSlots[h.mSlot];
+        removeEntry(slot.mBucket, slot.mPos);
+        releaseSlot(h.mSlot);
+        --mSize;
+        mTopValid = false;
+    }
+
+    // O(1).
+    size_t size() const
+    {
+        return mSize;
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+};
+
+// O(n log C). Same as copySorted for Heap.
+template< typename OutputIterator, typename Key, typename Value >
+void copySorted( RadixHeap< Key, Value > heap, OutputIterator o )
+{
+    while(!heap.empty())
+    {
+        *o = heap.top();
+        ++o;
+        heap.pop();
+    }
+}
+
+// O(n log C). Create sorted vector from the given heap.
+template< typename Key, typename Value >
+std::vector< std::pair< Key, Value > > toSortedVector( RadixHeap< Key, Value > heap )
+{
+    std::vector< std::pair< Key, Value > > result;
+    result.reserve(heap.size());
+    copySorted(std::move(heap), std::back_inserter(result));
+    return result;
+}
+
+// O(1). Swaps two heaps. See RadixHeap::swap for more.
+template< typename Key, typename Value >
+void swap( RadixHeap< Key, Value > & a, RadixHeap< Key, Value > & b ) { a.swap( b ); }
+
+#endif // CPP14_RADIX_HEAP
@@ -0,0 +1,626 @@
+/*
+ * Priority queue with the priorities stored apart from the values
+*/
+#include <functional> // less
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include "heap.h"
+
+#ifndef CPP14_SPLIT_PRIORITY_QUEUE
+#define CPP14_SPLIT_PRIORITY_QUEUE
+
+/*
+Priority queue of (priority, value) pairs, ordered like PriorityQueue< P, V,
+Cmp >, which keeps the priorities in a dense array of their own. The heap is
+made of that array and a parallel array of slot ids (the back-pointers to the
+handles), so the sifts compare and move only priorities and 32 bit slot ids,
+however large the values are. The values live in a slab indexed by the slot
+of their element, in blocks which never move, so a value is constructed once
+and never moved or copied by the heap. Use it instead of PriorityQueue when
+the values are much larger than the priorities.
+
+Because the pairs are not stored, top and get return a pair of references,
+std::pair< const P &, const V & >. Handles work the same way as the handles of
+Heap. The optional Arity parameter is the same as the one of Heap.
+ */
+template< typename P, typename V, typename Cmp = std::less< P >, size_t Arity = 2 >
+class SplitPriorityQueue : private CompareStorage< Cmp >
+{
+    using CompareBase = CompareStorage< Cmp >;
+
+    static_assert(Arity >= 2, "SplitPriorityQueue needs at least two children per node");
+    static_assert(alignof(V) <= alignof(std::max_align_t), "SplitPriorityQueue does not support over-aligned values");
+
+public:
+    struct Handle;
+    using value_type = std::pair< P, V >;
+    using reference = std::pair< const P &, const V & >;
+    using value_compare = Cmp;
+
+private:
+    using SlotId = std::uint32_t;
+
+    static constexpr SlotId InvalidSlot = std::numeric_limits<SlotId>::max();
+
+    // Same as Heap::Slot, the position is an index into mKeys.
+    struct Slot
+    {
+        SlotId mPos;
+        std::uint32_t mGeneration;
+    };
+
+    // The values by slot id, in blocks which never move. A value is
+    // constructed when its slot is acquired and destroyed when it is released,
+    // the slab does not know which of its cells are live.
+    class ValueSlab
+    {
+    private:
+        static constexpr size_t BlockBits = 8;
+        static constexpr size_t BlockSize = size_t(1) << BlockBits;
+
+        using Storage = typename std::aligned_storage<sizeof(V), alignof(V)>::type;
+
+        std::vector<std::unique_ptr<Storage[]>> mBlocks;
+
+        Storage& getCell(SlotId slot) const
+        {
+            return mBlocks[slot >> BlockBits][slot & (BlockSize - 1)];
+        }
+
+    public:
+        // Makes room for the values of the slots below count.
+        void reserve(size_t count)
+        {
+            while(mBlocks.size() * BlockSize < count)
+            {
+                std::unique_ptr<Storage[]> block(new Storage[BlockSize]);
+                mBlocks.push_back(std::move(block));
+            }
+        }
+
+        template< typename... Args >
+        void construct(SlotId slot, Args&&... args)
+        {
+            ::new (static_cast<void*>(&getCell(slot))) V(std::forward<Args>(args)...);
+        }
+
+        void destroy(SlotId slot)
+        {
+            (*this)[slot].~V();
+        }
+
+        V& operator[](SlotId slot)
+        {
+            return *reinterpret_cast<V*>(&getCell(slot));
+        }
+
+        const V& operator[](SlotId slot) const
+        {
+            return *reinterpret_cast<const V*>(&getCell(slot));
+        }
+    };
+
+    std::vector<P> mKeys;
+    std::vector<SlotId> mSlotOf;
+    std::vector<Slot> mSlots;
+    ValueSlab mValues;
+    SlotId mFreeSlot = InvalidSlot;
+
+    bool compare(const P& lhs, const P& rhs) const
+    {
+        return this->getCompare()(lhs, rhs);
+    }
+
+    SlotId acquireSlot(size_t pos)
+    {
+        SlotId slot = mFreeSlot;
+
+        if(slot == InvalidSlot)
+        {
+            slot = static_cast<SlotId>(mSlots.size());
+            mValues.reserve(mSlots.size() + 1);
+            mSlots.push_back(Slot{ 0, 0 });
+        }
+        else
+        {
+            mFreeSlot = mSlots[slot].mPos;
+        }
+
+        mSlots[slot].mPos = static_cast<SlotId>(pos);
+        ++mSlots[slot].mGeneration;
+
+        return slot;
+    }
+
+    void releaseSlot(SlotId slot)
+    {
+        mSlots[slot].mPos = mFreeSlot;
+        ++mSlots[slot].mGeneration;
+        mFreeSlot = slot;
+    }
+
+    // Moves the priority and the slot id at index from into the hole at index
+    // to. The value stays where it is.
+    void moveKey(size_t from, size_t to)
+    {
+        mKeys[to] = std::move(mKeys[from]);
+        mSlotOf[to] = mSlotOf[from];
+        mSlots[mSlotOf[to]].mPos = static_cast<SlotId>(to);
+    }
+
+    void placeKey(size_t index, P&& key, SlotId slot)
+    {
+        mKeys[index] = std::move(key);
+        mSlotOf[index] = slot;
+        mSlots[slot].mPos = static_cast<SlotId>(index);
+    }
+
+    size_t getFirstChildOf(size_t index) const
+    {
+        return Arity * index + 1;
+    }
+
+    size_t getParentOf(size_t index) const
+    {
+        return (index - 1) / Arity;
+    }
+
+    // Same as Heap::getTopChildOf, it reads only the priorities.
+    size_t getTopChildOf(size_t index) const
+    {
+        size_t child = getFirstChildOf(index);
+
+        if(child >= mKeys.size()) { return mKeys.size(); }
+
+        size_t last = std::min(child + Arity, mKeys.size());
+        size_t selectedChild = child;
+
+        for(++child; child < last; ++child)
+        {
+            if(compare(mKeys[selectedChild], mKeys[child]))
+            {
+                selectedChild = child;
+            }
+        }
+
+        return selectedChild;
+    }
+
+    // Same as Heap::bubbleUp, with the hole in the priorities and slot ids.
+    size_t bubbleUp(size_t index)
+    {
+        if(index == 0 || index >= mKeys.size()) { return index; }
+
+        size_t parent = getParentOf(index);
+        if(!compare(mKeys[parent], mKeys[index])) { return index; }
+
+        P key = std::move(mKeys[index]);
+        SlotId slot = mSlotOf[index];
+
+        do
+        {
+            moveKey(parent, index);
+            index = parent;
+            parent = getParentOf(index);
+        } while(index > 0 && compare(mKeys[parent], key));
+
+        placeKey(index, std::move(key), slot);
+        return index;
+    }
+
+    // Same as Heap::bubbleDown.
+    size_t bubbleDown(size_t index)
+    {
+        size_t child = getTopChildOf(index);
+        if(child >= mKeys.size() || !compare(mKeys[index], mKeys[child])) { return index; }
+
+        P key = std::move(mKeys[index]);
+        SlotId slot = mSlotOf[index];
+
+        do
+        {
+            moveKey(child, index);
+            index = child;
+            child = getTopChildOf(index);
+        } while(child < mKeys.size() && compare(key, mKeys[child]));
+
+        placeKey(index, std::move(key), slot);
+        return index;
+    }
+
+    template< typename Key, typename... Args >
+    Handle emplaceOp(Key&& priority, Args&&... args)
+    {
+        size_t pos = mKeys.size();
+        SlotId slot = acquireSlot(pos);
+
+        try
+        {
+            mValues.construct(slot, std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            releaseSlot(slot);
+            throw;
+        }
+
+        try
+        {
+            mSlotOf.push_back(slot);
+            mKeys.push_back(std::forward<Key>(priority));
+        }
+        catch(...)
+        {
+            if(mSlotOf.size() > mKeys.size()) { mSlotOf.pop_back(); }
+            mValues.destroy(slot);
+            releaseSlot(slot);
+            throw;
+        }
+
+        bubbleUp(pos);
+        return Handle(slot, mSlots[slot].mGeneration);
+    }
+
+    void updateKeyOp(size_t pos, P&& priority)
+    {
+        bool moveUp = compare(mKeys[pos], priority);
+        mKeys[pos] = std::move(priority);
+
+        if(moveUp) { bubbleUp(pos); }
+        else { bubbleDown(pos); }
+    }
+
+    void eraseAt(size_t pos)
+    {
+        SlotId slot = mSlotOf[pos];
+        size_t last = mKeys.size() - 1;
+
+        mValues.destroy(slot);
+        releaseSlot(slot);
+        if(pos != last) { moveKey(last, pos); }
+        mKeys.pop_back();
+        mSlotOf.pop_back();
+
+        if(pos < mKeys.size() && bubbleDown(pos) == pos) { bubbleUp(pos); }
+    }
+
+    // The positions of the elements in the order they would be popped in.
+    std::vector<size_t> sortedPositions() const
+    {
+        std::vector<size_t> positions(mKeys.size());
+        for(size_t i = 0; i < positions.size(); ++i) { positions[i] = i; }
+
+        std::sort(positions.begin(), positions.end(), [this](size_t lhs, size_t rhs)
+        {
+            return compare(mKeys[rhs], mKeys[lhs]);
+        });
+
+        return positions;
+    }
+
+    void destroyValues()
+    {
+        for(SlotId slot : mSlotOf)
+        {
+            mValues.destroy(slot);
+        }
+    }
+
+public:
+    // Same requirements as Heap::Handle.
+    struct Handle
+    {
+    private:
+        SlotId mSlot = InvalidSlot;
+        std::uint32_t mGeneration = 0;
+
+        Handle(SlotId slot, std::uint32_t generation)
+            :mSlot(slot), mGeneration(generation) { }
+
+    public:
+        Handle() = default;
+
+        Handle(const Handle&) = default;
+
+        Handle(Handle&&) noexcept = default;
+
+        Handle& operator=(const Handle&) = default;
+
+        Handle& operator=(Handle&&) noexcept = default;
+
+        bool operator==(const Handle &o) const
+        {
+            return mSlot == o.mSlot && mGeneration == o.mGeneration;
+        }
+
+        bool operator!=(const Handle &o) const
+        {
+            return !(*this == o);
+        }
+
+        friend class SplitPriorityQueue;
+    };
+
+    // O(1).
+    SplitPriorityQueue() = default;
+
+    // O(1). Create an empty queue ordered by the given comparator of
+    // priorities.
+    explicit SplitPriorityQueue( const Cmp & compare )
+        :CompareBase(compare) { }
+
+    // O(n). The handles from other should not be used with this.
+    SplitPriorityQueue( const SplitPriorityQueue & other )
+        :CompareBase(other.getCompare()),
+         mKeys(other.mKeys),
+         mSlotOf(other.mSlotOf),
+         mSlots(other.mSlots),
+         mFreeSlot(other.mFreeSlot)
+    {
+        mValues.reserve(mSlots.size());
+        size_t i = 0;
+
+        try
+        {
+            for(; i < mSlotOf.size(); ++i)
+            {
+                mValues.construct(mSlotOf[i], other.mValues[mSlotOf[i]]);
+            }
+        }
+        catch(...)
+        {
+            while(i-- > 0) { mValues.destroy(mSlotOf[i]); }
+            throw;
+        }
+    }
+
+    // O(1). All handles for other are valid handles for this.
+    SplitPriorityQueue( SplitPriorityQueue && other ) noexcept(std::is_nothrow_copy_constructible< Cmp >::value)
+        :CompareBase(other.getCompare())
+    {
+        swap(other);
+    }
+
+    // O(n).
+    SplitPriorityQueue &operator=( SplitPriorityQueue other )
+    {
+        swap(other);
+        return *this;
+    }
+
+    // O(n). Invalidates all handles to this.
+    ~SplitPriorityQueue()
+    {
+        destroyValues();
+    }
+
+    // O(1). After the swap all handles for this are valid handles for other
+    // and vice versa.
+    void swap( SplitPriorityQueue &other )
+    {
+        using std::swap;
+        swap(this->getCompare(), other.getCompare());
+        swap(mKeys, other.mKeys);
+        swap(mSlotOf, other.mSlotOf);
+        swap(mSlots, other.mSlots);
+        swap(mValues, other.mValues);
+        swap(mFreeSlot, other.mFreeSlot);
+    }
+
+    // O(1). Get the comparator of priorities the queue is ordered by.
+    Cmp value_comp() const
+    {
+        return this->getCompare();
+    }
+
+    // O(1). Get the top element. Precondition: the queue must not be empty.
+    reference top() const
+    {
+        return reference(mKeys[0], mValues[mSlotOf[0]]);
+    }
+
+    // O(1). Get handle to the top element.
+    Handle topHandle() const
+    {
+        return Handle(mSlotOf[0], mSlots[mSlotOf[0]].mGeneration);
+    }
+
+    // O(log n). Remove the top element. Only the handle to the removed
+    // element is invalidated.
+    void pop()
+    {
+        if(!empty()) { eraseAt(0); }
+    }
+
+    // O(log n). Remove the top element and return it, the priority and the
+    // value are moved out. Precondition: the queue must not be empty.
+    value_type extractTop()
+    {
+        value_type result(std::move(mKeys[0]), std::move(mValues[mSlotOf[0]]));
+        eraseAt(0);
+        return result;
+    }
+
+    // O(log n). Insert an element and return a handle for it. No handles are
+    // invalidated.
+    Handle insert( const value_type & value )
+    {
+        return emplaceOp(value.first, value.second);
+    }
+
+    // O(log n). A version of insert which moves the element.
+    Handle insert( value_type && value )
+    {
+        return emplaceOp(std::move(value.first), std::move(value.second));
+    }
+
+    // O(log n). Construct the value in place from args, it is never moved
+    // afterwards, so V does not have to be movable.
+    template< typename Key, typename... Args >
+    Handle emplace( Key &&priority, Args &&... args )
+    {
+        return emplaceOp(std::forward<Key>(priority), std::forward<Args>(args)...);
+    }
+
+    // O(1). Precondition: h must be a valid handle for this.
+    reference get( const Handle &h ) const
+    {
+        return reference(mKeys[mSlots[h.mSlot].mPos], mValues[h.mSlot]);
+    }
+
+    // O(1). Does the handle refer to an element of this queue?
+    bool contains( const Handle &h ) const
+    {
+        return h.mSlot < mSlots.size() && mSlots[h.mSlot].mGeneration == h.mGeneration;
+    }
+
+    // O(log n). Replace the element represented by the given handle.
+    // Precondition: h must be a valid handle for this.
+    void update( const Handle &h, const value_type &value )
+    {
+        if(empty()) { return; }
+
+        mValues[h.mSlot] = value.second;
+        updateKeyOp(mSlots[h.mSlot].mPos, P(value.first));
+    }
+
+    // O(log n). A version of update which moves the element.
+    void update( const Handle &h, value_type &&value )
+    {
+        if(empty()) { return; }
+
+        mValues[h.mSlot] = std::move(value.second);
+        updateKeyOp(mSlots[h.mSlot].mPos, std::move(value.first));
+    }
+
+    // O(log n). Change only the priority of the element represented by the
+    // given handle, its value is not touched, e.g. for decrease-key.
+    // Precondition: h must be a valid handle for this.
+    void updatePriority( const Handle &h, P priority )
+    {
+        if(empty()) { return; }
+
+        updateKeyOp(mSlots[h.mSlot].mPos, std::move(priority));
+    }
+
+    // O(1). Get the value represented by the given handle for modification,
+    // which does not change the order. Precondition: h must be a valid handle
+    // for this.
+    V &getValue( const Handle &h )
+    {
+        return mValues[h.mSlot];
+    }
+
+    // O(log n). Erase the element represented by the given handle.
+    // Invalidates h, but does not invalidate handles to other elements.
+    void erase( const Handle &h )
+    {
+        if(empty()) { return; }
+
+        eraseAt(mSlots[h.mSlot].mPos);
+    }
+
+    // O(n log n). Get the elements in the order they would be popped in (top
+    // first). Positions are sorted by their priorities only, then the elements
+    // are copied out in that order. The queue and its handles are not touched.
+    std::vector< value_type > sortedValues() const &
+    {
+        std::vector< value_type > result;
+        result.reserve(mKeys.size());
+
+        for(size_t pos : sortedPositions())
+        {
+            result.emplace_back(mKeys[pos], mValues[mSlotOf[pos]]);
+        }
+
+        return result;
+    }
+
+    // O(n log n). A version of sortedValues which moves the elements out of
+    // the queue. The queue is left empty and all its handles become invalid.
+    std::vector< value_type > sortedValues() &&
+    {
+        std::vector< value_type > result;
+        result.reserve(mKeys.size());
+
+        for(size_t pos : sortedPositions())
+        {
+            result.emplace_back(std::move(mKeys[pos]), std::move(mValues[mSlotOf[pos]]));
+        }
+
+        destroyValues();
+        for(SlotId slot : mSlotOf)
+        {
+            releaseSlot(slot);
+        }
+        mKeys.clear();
+        mSlotOf.clear();
+
+        return result;
+    }
+
+    // O(1).
+    size_t size() const
+    {
+        return mKeys.size();
+    }
+
+    // O(1).
+    bool empty() const
+    {
+        return mKeys.empty();
+    }
+};
+
+// O(n log n). Same as copySorted for Heap, the elements are copied and
+// sorted without maintaining any handles, see
+// SplitPriorityQueue::sortedValues.
+template< typename OutputIterator, typename P, typename V, typename Cmp, size_t Arity >
+void copySorted( const SplitPriorityQueue< P, V, Cmp, Arity > & queue, OutputIterator o )
+{
+    for(auto& value : queue.sortedValues())
+    {
+        *o = std::move(value);
+        ++o;
+    }
+}
+
+// O(n log n). A version of copySorted which moves the elements out of the
+// queue.
+template< typename OutputIterator, typename P, typename V, typename Cmp, size_t Arity >
+void copySorted( SplitPriorityQueue< P, V, Cmp, Arity > && queue, OutputIterator o )
+{
+    for(auto& value : std::move(queue).sortedValues())
+    {
+        *o = std::move(value);
+        ++o;
+    }
+}
+
+// O(n log n). Create sorted vector from the given queue.
+template< typename P, typename V, typename Cmp, size_t Arity >
+std::vector< std::pair< P, V > > toSortedVector( const SplitPriorityQueue< P, V, Cmp, Arity > & queue )
+{
+    return queue.sortedValues();
+}
+
+// O(n log n). A version of toSortedVector which moves the elements out of
+// the queue.
+template< typename P, typename V, typename Cmp, size_t Arity >
+std::vector< std::pair< P, V > > toSortedVector( SplitPriorityQueue< P, V, Cmp, Arity > && queue )
+{
+    return std::move(queue).sortedValues();
+}
+
+// O(1). Swaps two queues. See SplitPriorityQueue::swap for more.
+template< typename P, typename V, typename Cmp, size_t Arity >
+void swap( SplitPriorityQueue< P, V, Cmp, Arity > & a, SplitPriorityQueue< P, V, Cmp, Arity > & b ) { a.swap( b ); }
+
+#endif // CPP14_SPLIT_PRIORITY_QUEUE
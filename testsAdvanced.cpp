@@ -5,14 +5,19 @@
 #include <utility>
 #include <string>
 #include <chrono>
+#include <sstream>
+#include <iterator>
+#include <random>
+#include <memory>
+#include <thread>
 #include "catch.hpp"
 #include "heap.h"
 
 #define ALLOW_TESTS
-#undef ALLOW_TESTS
+//#undef ALLOW_TESTS
 
 #define MOVE_ONLY
-#undef MOVE_ONLY
+//#undef MOVE_ONLY
 
 #ifdef ALLOW_TESTS
 
@@ -499,6 +504,882 @@ TEST_CASE("Random data")
     }
 }
 
+struct WeightCmp
+{
+    const std::vector<int>* mWeights;
+
+    bool operator()(int lhs, int rhs) const
+    {
+        return (*mWeights)[lhs] < (*mWeights)[rhs];
+    }
+};
+
+TEST_CASE("Stateful comparator")
+{
+    std::vector<int> weights { 5, 1, 9, 3, 7 };
+    WeightCmp cmp { &weights };
+
+    SECTION("Empty comparator takes no space")
+    {
+        REQUIRE(sizeof(MinHeap<int>) < sizeof(Heap<int, WeightCmp>));
+    }
+
+    SECTION("Insert")
+    {
+        Heap<int, WeightCmp> heap(cmp);
+
+        for(int i = 0; i < 5; ++i)
+        {
+            heap.insert(i);
+        }
+
+        REQUIRE(toSortedVector(heap) == std::vector<int>({ 2, 4, 0, 3, 1 }));
+    }
+
+    SECTION("Range ctor, copy and swap")
+    {
+        std::vector<int> otherWeights { 1, 2, 3, 4, 5 };
+        std::vector<int> ids { 0, 1, 2, 3, 4 };
+
+        Heap<int, WeightCmp> heap(ids.begin(), ids.end(), cmp);
+        Heap<int, WeightCmp> other({ 0, 1, 2, 3, 4 }, WeightCmp { &otherWeights });
+        Heap<int, WeightCmp> copy = heap;
+
+        REQUIRE(heap.top() == 2);
+        REQUIRE(copy.top() == 2);
+        REQUIRE(other.top() == 4);
+
+        heap.swap(other);
+        heap.pop();
+        other.pop();
+
+        REQUIRE(heap.top() == 3);
+        REQUIRE(other.top() == 4);
+    }
+
+    SECTION("Priority queue")
+    {
+        PriorityQueue<int, std::string, WeightCmp> q(cmp);
+
+        q.insert({ 1, "low" });
+        q.insert({ 2, "high" });
+        q.insert({ 0, "mid" });
+
+        REQUIRE(q.top().second == "high");
+    }
+}
+
+template<size_t Arity>
+void checkArity()
+{
+    Heap<int, std::greater<int>, Arity> heap;
+    std::vector<typename Heap<int, std::greater<int>, Arity>::Handle> handles;
+    std::vector<int> vct;
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        vct.push_back(rand() % 500);
+        handles.push_back(heap.insert(vct.back()));
+        REQUIRE(heap.top() == *std::min_element(vct.begin(), vct.end()));
+    }
+
+    for(size_t i = 0; i < handles.size(); i += 3)
+    {
+        vct[i] = rand() % 500;
+        heap.update(handles[i], vct[i]);
+    }
+
+    for(size_t i = 1; i < handles.size(); i += 7)
+    {
+        heap.erase(handles[i]);
+        vct[i] = -1;
+    }
+
+    vct.erase(std::remove(vct.begin(), vct.end(), -1), vct.end());
+    std::sort(vct.begin(), vct.end());
+
+    REQUIRE(toSortedVector(heap) == vct);
+    REQUIRE(toSortedVector(Heap<int, std::greater<int>, Arity>(vct.rbegin(), vct.rend())) == vct);
+}
+
+TEST_CASE("D-ary heaps")
+{
+    srand(time(NULL));
+
+    SECTION("Arity 3") { checkArity<3>(); }
+    SECTION("Arity 4") { checkArity<4>(); }
+    SECTION("Arity 8") { checkArity<8>(); }
+    SECTION("Arity 16") { checkArity<16>(); }
+}
+
+struct MoveCounter
+{
+    static size_t sMoves;
+
+    MoveCounter(int x)
+        :mX(x) { }
+
+    MoveCounter(MoveCounter&& o) noexcept
+        :mX(o.mX) { ++sMoves; }
+
+    MoveCounter& operator=(MoveCounter&& o) noexcept
+    {
+        mX = o.mX;
+        ++sMoves;
+        return *this;
+    }
+
+    int mX;
+};
+
+size_t MoveCounter::sMoves = 0;
+
+struct MoveCounterCmp
+{
+    bool operator()(const MoveCounter& lhs, const MoveCounter& rhs) const
+    {
+        return lhs.mX > rhs.mX;
+    }
+};
+
+TEST_CASE("Sift moves")
+{
+    // 1023 elements form a complete tree of depth 9
+    const size_t depth = 9;
+    Heap<MoveCounter, MoveCounterCmp> heap;
+
+    for(int i = 0; i < 1023; ++i)
+    {
+        heap.insert(MoveCounter((i * 7919) % 1023));
+    }
+
+    SECTION("Pop")
+    {
+        for(int i = 0; i < 512; ++i)
+        {
+            MoveCounter::sMoves = 0;
+            heap.pop();
+
+            // one move of the last element into the root, one out of and
+            // into the hole, and one per level shifted
+            REQUIRE(MoveCounter::sMoves <= depth + 3);
+        }
+    }
+
+    SECTION("Insert")
+    {
+        heap.pop();
+
+        MoveCounter::sMoves = 0;
+        heap.insert(MoveCounter(-1));
+
+        // one move into the storage, then the same as for pop
+        REQUIRE(heap.top().mX == -1);
+        REQUIRE(MoveCounter::sMoves <= depth + 3);
+    }
+
+    SECTION("Emplace")
+    {
+        heap.pop();
+
+        MoveCounter::sMoves = 0;
+        heap.emplace(-1);
+
+        REQUIRE(heap.top().mX == -1);
+        REQUIRE(MoveCounter::sMoves <= depth + 2);
+    }
+}
+
+TEST_CASE("Emplace")
+{
+    SECTION("Heap")
+    {
+        Heap<std::string, std::greater<std::string>> heap;
+
+        auto h = heap.emplace(3, 'b');
+        heap.emplace("aaa");
+        heap.emplace("cc", 1);
+
+        REQUIRE(heap.get(h) == "bbb");
+        REQUIRE(heap.top() == "aaa");
+        REQUIRE(toSortedVector(heap) == std::vector<std::string>({ "aaa", "bbb", "c" }));
+    }
+
+    SECTION("Priority queue")
+    {
+        PriorityQueue<int, std::string> q;
+
+        q.emplace(1, "one");
+        auto h = q.emplace(2, 3, 'x');
+        q.emplace(std::make_pair(0, std::string("zero")));
+
+        REQUIRE(q.topHandle() == h);
+        REQUIRE(q.top().second == "xxx");
+        REQUIRE(q.size() == 3);
+    }
+}
+
+TEST_CASE("Bulk insert")
+{
+    srand(time(NULL));
+
+    MaxHeap<int> heap;
+    std::vector<MaxHeap<int>::Handle> handles;
+    std::vector<int> values;
+
+    SECTION("Batches of 30 %")
+    {
+        for(size_t i = 0; i < 20; ++i)
+        {
+            std::vector<int> batch;
+
+            for(size_t j = 0; j < values.size() * 3 / 10 + 1; ++j)
+            {
+                batch.push_back(rand() % 10000);
+            }
+
+            heap.insert(batch.begin(), batch.end(), std::back_inserter(handles));
+            values.insert(values.end(), batch.begin(), batch.end());
+
+            REQUIRE(heap.size() == values.size());
+            REQUIRE(heap.top() == *std::max_element(values.begin(), values.end()));
+        }
+    }
+
+    SECTION("Small batches")
+    {
+        for(int i = 0; i < 500; ++i)
+        {
+            std::vector<int> batch { rand() % 10000, rand() % 10000 };
+
+            heap.insert(batch.begin(), batch.end(), std::back_inserter(handles));
+            values.insert(values.end(), batch.begin(), batch.end());
+        }
+    }
+
+    SECTION("Input iterator without handles")
+    {
+        std::vector<int> vct = getRange(1, 1000);
+        std::shuffle(vct.begin(), vct.end(), std::mt19937());
+        std::istringstream in;
+        std::string text;
+
+        for(int a : vct)
+        {
+            text += std::to_string(a) + " ";
+        }
+        in.str(text);
+
+        heap.insert(5000);
+        heap.insert(-5);
+        heap.insert(std::istream_iterator<int>(in), std::istream_iterator<int>());
+
+        REQUIRE(heap.size() == 1002);
+        REQUIRE(heap.top() == 5000);
+        return;
+    }
+
+    REQUIRE(handles.size() == values.size());
+
+    for(size_t i = 0; i < handles.size(); ++i)
+    {
+        REQUIRE(heap.get(handles[i]) == values[i]);
+    }
+
+    for(size_t i = 0; i < handles.size(); i += 2)
+    {
+        heap.update(handles[i], values[i] = rand() % 10000);
+    }
+
+    std::sort(values.rbegin(), values.rend());
+    REQUIRE(toSortedVector(heap) == values);
+}
+
+TEST_CASE("Bulk erase")
+{
+    srand(time(NULL));
+
+    PriorityQueue<int, int> q;
+    std::vector<PriorityQueue<int, int>::Handle> handles;
+
+    // second member is the tenant
+    for(int i = 0; i < 5000; ++i)
+    {
+        handles.push_back(q.insert({ rand() % 1000, i % 7 }));
+    }
+
+    auto checkSurvivors = [&](const std::vector<bool>& erased)
+    {
+        for(size_t i = 0; i < handles.size(); ++i)
+        {
+            REQUIRE(q.contains(handles[i]) == !erased[i]);
+
+            if(!erased[i])
+            {
+                REQUIRE(q.get(handles[i]).second == static_cast<int>(i % 7));
+            }
+        }
+
+        auto sorted = toSortedVector(q);
+        REQUIRE(std::is_sorted(sorted.rbegin(), sorted.rend(), PairCompare<int, int, std::less<int>>()));
+    };
+
+    SECTION("erase_if")
+    {
+        std::vector<bool> erased(handles.size());
+
+        for(size_t i = 0; i < handles.size(); ++i)
+        {
+            erased[i] = (i % 7 == 3);
+        }
+
+        REQUIRE(q.erase_if([](const std::pair<int, int>& p) { return p.second == 3; }) == 714);
+        REQUIRE(q.size() == 5000 - 714);
+        checkSurvivors(erased);
+
+        REQUIRE(q.erase_if([](const std::pair<int, int>& p) { return p.second == 3; }) == 0);
+    }
+
+    SECTION("Handle range")
+    {
+        std::vector<bool> erased(handles.size());
+        std::vector<PriorityQueue<int, int>::Handle> toErase;
+
+        for(size_t i = 0; i < handles.size(); i += 1 + rand() % 5)
+        {
+            erased[i] = true;
+            toErase.push_back(handles[i]);
+        }
+
+        // duplicates and invalid handles are skipped
+        toErase.push_back(toErase.front());
+        toErase.push_back(PriorityQueue<int, int>::Handle());
+
+        REQUIRE(q.erase(toErase.begin(), toErase.end()) == toErase.size() - 2);
+        checkSurvivors(erased);
+    }
+
+    SECTION("Throwing predicate")
+    {
+        int calls = 0;
+
+        REQUIRE_THROWS(q.erase_if([&](const std::pair<int, int>&)
+        {
+            if(++calls == 1000) { throw 1; }
+            return calls % 2 == 0;
+        }));
+
+        REQUIRE(q.size() == 5000 - 499);
+
+        auto sorted = toSortedVector(q);
+        REQUIRE(std::is_sorted(sorted.rbegin(), sorted.rend(), PairCompare<int, int, std::less<int>>()));
+    }
+}
+
+struct UniquePtrCmp
+{
+    bool operator()(const std::unique_ptr<int>& lhs, const std::unique_ptr<int>& rhs) const
+    {
+        return *lhs > *rhs;
+    }
+};
+
+TEST_CASE("Extract")
+{
+    Heap<std::unique_ptr<int>, UniquePtrCmp> heap;
+    std::vector<Heap<std::unique_ptr<int>, UniquePtrCmp>::Handle> handles;
+
+    for(int i = 10; i > 0; --i)
+    {
+        handles.push_back(heap.emplace(new int(i)));
+    }
+
+    SECTION("extractTop")
+    {
+        auto top = heap.extractTop();
+
+        REQUIRE(*top == 1);
+        REQUIRE(*heap.top() == 2);
+        REQUIRE(heap.size() == 9);
+    }
+
+    SECTION("extract")
+    {
+        auto value = heap.extract(handles[3]);
+
+        REQUIRE(*value == 7);
+        REQUIRE_FALSE(heap.contains(handles[3]));
+        REQUIRE(heap.size() == 9);
+        REQUIRE(*heap.get(handles[2]) == 8);
+    }
+
+    SECTION("toSortedVector moves the values out")
+    {
+        auto sorted = toSortedVector(std::move(heap));
+
+        REQUIRE(sorted.size() == 10);
+
+        for(int i = 0; i < 10; ++i)
+        {
+            REQUIRE(*sorted[i] == i + 1);
+        }
+    }
+}
+
+TEST_CASE("Modify")
+{
+    SECTION("Priority queue")
+    {
+        PriorityQueue<int, std::string> q;
+        std::vector<PriorityQueue<int, std::string>::Handle> handles;
+
+        for(int i = 0; i < 100; ++i)
+        {
+            handles.push_back(q.insert({ i, std::to_string(i) }));
+        }
+
+        q.modify(handles[10], [](std::pair<int, std::string>& p) { p.first = 1000; });
+        REQUIRE(q.top().second == "10");
+
+        q.modify(handles[10], [](std::pair<int, std::string>& p) { p.first = -1; });
+        REQUIRE(q.top().second == "99");
+
+        q.modify(handles[99], [](std::pair<int, std::string>& p) { p.second = "top"; });
+        REQUIRE(q.topHandle() == handles[99]);
+        REQUIRE(q.top().second == "top");
+
+        auto sorted = toSortedVector(q);
+        REQUIRE(sorted.back() == std::make_pair(-1, std::string("10")));
+    }
+
+    SECTION("No moves into the storage")
+    {
+        const size_t depth = 9;
+        Heap<MoveCounter, MoveCounterCmp> heap;
+        std::vector<Heap<MoveCounter, MoveCounterCmp>::Handle> handles;
+
+        for(int i = 0; i < 1023; ++i)
+        {
+            handles.push_back(heap.insert(MoveCounter(i)));
+        }
+
+        MoveCounter::sMoves = 0;
+        heap.modify(handles[1022], [](MoveCounter& m) { m.mX = -1; });
+
+        REQUIRE(heap.top().mX == -1);
+        REQUIRE(MoveCounter::sMoves <= depth + 2);
+    }
+
+    SECTION("Throwing modifier")
+    {
+        MinHeap<int> heap { 5, 3, 8, 1 };
+        auto h = heap.insert(4);
+
+        REQUIRE_THROWS(heap.modify(h, [](int& x) { x = 0; throw 1; }));
+        REQUIRE(heap.top() == 0);
+        REQUIRE(heap.topHandle() == h);
+    }
+}
+
+TEST_CASE("Parallel build")
+{
+    std::vector<int> vct(300000);
+    std::mt19937 randgen;
+    std::generate(vct.begin(), vct.end(), randgen);
+
+    std::vector<int> sorted = vct;
+    std::sort(sorted.begin(), sorted.end());
+
+    SECTION("Binary heap")
+    {
+        for(size_t threads : { 1, 3, 4, 8 })
+        {
+            MinHeap<int> heap(vct.begin(), vct.end(), BuildThreads(threads));
+
+            REQUIRE(heap.size() == vct.size());
+            REQUIRE(toSortedVector(heap) == sorted);
+        }
+    }
+
+    SECTION("4-ary heap")
+    {
+        Heap<int, std::greater<int>, 4> heap(vct.begin(), vct.end(), BuildThreads(6));
+        std::vector<int> result = toSortedVector(heap);
+
+        REQUIRE(result == sorted);
+    }
+
+    SECTION("Small ranges")
+    {
+        for(size_t count = 0; count < 40; ++count)
+        {
+            MinHeap<int> heap(vct.begin(), vct.begin() + count, BuildThreads(4));
+            std::vector<int> expected(vct.begin(), vct.begin() + count);
+            std::sort(expected.begin(), expected.end());
+
+            REQUIRE(toSortedVector(heap) == expected);
+        }
+    }
+
+    SECTION("Comparators with state stay on one thread")
+    {
+        struct ThreadCmp
+        {
+            std::thread::id mOwner;
+            bool* mShared;
+
+            bool operator()(int lhs, int rhs) const
+            {
+                if(std::this_thread::get_id() != mOwner) { *mShared = true; }
+                return lhs > rhs;
+            }
+        };
+
+        bool shared = false;
+        Heap<int, ThreadCmp> heap(vct.begin(), vct.end(), ThreadCmp{ std::this_thread::get_id(), &shared });
+
+        REQUIRE_FALSE(shared);
+        REQUIRE(heap.size() == vct.size());
+        REQUIRE(heap.top() == sorted.front());
+    }
+
+    SECTION("Handles stay usable")
+    {
+        MinHeap<int> heap(vct.begin(), vct.end(), BuildThreads(4));
+        auto h = heap.insert(0);
+
+        heap.update(h, sorted.front() - 1);
+        REQUIRE(heap.topHandle() == h);
+
+        heap.pop();
+        REQUIRE(heap.top() == sorted.front());
+        REQUIRE(heap.size() == vct.size());
+    }
+}
+
+TEST_CASE("Sorted values")
+{
+    std::vector<int> vct(1000);
+    std::mt19937 randgen;
+    std::generate(vct.begin(), vct.end(), [&randgen] { return static_cast<int>(randgen() % 500); });
+
+    std::vector<int> sorted = vct;
+    std::sort(sorted.begin(), sorted.end());
+
+    SECTION("Binary heap is not changed")
+    {
+        MinHeap<int> heap;
+        std::vector<MinHeap<int>::Handle> handles;
+        for(int x : vct) { handles.push_back(heap.insert(x)); }
+
+        auto top = heap.topHandle();
+        REQUIRE(heap.sortedValues() == sorted);
+
+        std::vector<int> copied;
+        copySorted(heap, std::back_inserter(copied));
+        REQUIRE(copied == sorted);
+
+        REQUIRE(heap.size() == vct.size());
+        REQUIRE(heap.topHandle() == top);
+        for(size_t i = 0; i < vct.size(); ++i)
+        {
+            REQUIRE(heap.get(handles[i]) == vct[i]);
+        }
+    }
+
+    SECTION("4-ary heap")
+    {
+        Heap<int, std::less<int>, 4> heap(vct.begin(), vct.end());
+        std::vector<int> result = toSortedVector(heap);
+
+        REQUIRE(std::equal(result.begin(), result.end(), sorted.rbegin(), sorted.rend()));
+    }
+
+    SECTION("Moved out")
+    {
+        MinHeap<int> heap(vct.begin(), vct.end());
+        auto h = heap.topHandle();
+
+        REQUIRE(std::move(heap).sortedValues() == sorted);
+        REQUIRE(heap.empty());
+        REQUIRE_FALSE(heap.contains(h));
+    }
+
+    SECTION("Sorted on more threads")
+    {
+        for(size_t threads : { 2, 3, 4, 7 })
+        {
+            MinHeap<int> heap(vct.begin(), vct.end());
+            REQUIRE(heap.sortedValues(BuildThreads(threads)) == sorted);
+            REQUIRE(std::move(heap).sortedValues(BuildThreads(threads)) == sorted);
+
+            Heap<int, std::less<int>, 4> wide(vct.begin(), vct.end());
+            std::vector<int> result = wide.sortedValues(BuildThreads(threads));
+            REQUIRE(std::equal(result.begin(), result.end(), sorted.rbegin(), sorted.rend()));
+        }
+    }
+}
+
+TEST_CASE("Top k")
+{
+    std::vector<int> vct(10000);
+    std::mt19937 randgen;
+    std::generate(vct.begin(), vct.end(), [&randgen] { return static_cast<int>(randgen() % 3000); });
+
+    std::vector<int> sorted = vct;
+    std::sort(sorted.begin(), sorted.end());
+
+    SECTION("Binary heap")
+    {
+        MinHeap<int> heap;
+        std::vector<MinHeap<int>::Handle> handles;
+        for(int x : vct) { handles.push_back(heap.insert(x)); }
+        auto top = heap.topHandle();
+
+        for(size_t k : { 0, 1, 2, 100, 9999, 10000, 20000 })
+        {
+            std::vector<int> best;
+            heap.topK(k, std::back_inserter(best));
+            size_t expected = std::min(k, sorted.size());
+
+            REQUIRE(best.size() == expected);
+            REQUIRE(std::equal(best.begin(), best.end(), sorted.begin()));
+        }
+
+        REQUIRE(heap.size() == vct.size());
+        REQUIRE(heap.topHandle() == top);
+        REQUIRE(heap.get(handles[42]) == vct[42]);
+    }
+
+    SECTION("8-ary heap")
+    {
+        Heap<int, std::less<int>, 8> heap(vct.begin(), vct.end());
+        std::vector<int> best(100);
+
+        REQUIRE(heap.topK(100, best.begin()) == best.end());
+        REQUIRE(std::equal(best.begin(), best.end(), sorted.rbegin()));
+    }
+
+    SECTION("Empty heap")
+    {
+        MinHeap<int> heap;
+        std::vector<int> best;
+        heap.topK(10, std::back_inserter(best));
+
+        REQUIRE(best.empty());
+    }
+}
+
+TEST_CASE("Merge")
+{
+    using Handle = MinHeap<int>::Handle;
+
+    auto fill = [](MinHeap<int>& heap, std::vector<std::pair<Handle, int>>& handles, int from, int count)
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            int value = (from + i) * 7919 % 100003;
+            handles.emplace_back(heap.insert(value), value);
+        }
+    };
+
+    // the values in rehandled are in heap without their original handles
+    auto check = [](MinHeap<int>& heap, const std::vector<std::pair<Handle, int>>& handles,
+                    std::vector<int> rehandled)
+    {
+        std::vector<int> expected = std::move(rehandled);
+
+        for(const auto& h : handles)
+        {
+            if(!heap.contains(h.first)) { continue; }
+
+            REQUIRE(heap.get(h.first) == h.second);
+            expected.push_back(h.second);
+        }
+
+        std::sort(expected.begin(), expected.end());
+        REQUIRE(heap.size() == expected.size());
+        REQUIRE(toSortedVector(heap) == expected);
+    };
+
+    for(int otherSize : { 0, 3, 500, 3000 })
+    {
+        MinHeap<int> heap, other;
+        std::vector<std::pair<Handle, int>> handles;
+
+        fill(heap, handles, 0, 1000);
+        fill(other, handles, 1000, otherSize);
+
+        heap.erase(handles[10].first);
+        if(otherSize > 0) { other.erase(handles[1000].first); }
+
+        heap.merge(std::move(other));
+
+        REQUIRE(other.empty());
+        REQUIRE_FALSE(heap.contains(handles[10].first));
+
+        // fewer elements than half a block of handles are copied with new
+        // handles, larger heaps keep theirs
+        std::vector<int> rehandled;
+        if(otherSize < 512)
+        {
+            for(size_t i = 1000; i < handles.size(); ++i)
+            {
+                REQUIRE_FALSE(heap.contains(handles[i].first));
+                if(i > 1000) { rehandled.push_back(handles[i].second); }
+            }
+            handles.resize(1000);
+        }
+        check(heap, handles, rehandled);
+
+        // the free slots of both heaps are reused, all handles stay distinct
+        fill(heap, handles, 5000, 300);
+        for(size_t i = 0; i < handles.size(); i += 37)
+        {
+            if(heap.contains(handles[i].first))
+            {
+                heap.update(handles[i].first, -static_cast<int>(i));
+                handles[i].second = -static_cast<int>(i);
+            }
+        }
+        check(heap, handles, rehandled);
+
+        // other is empty but usable
+        other.insert(1);
+        REQUIRE(other.top() == 1);
+    }
+
+    SECTION("Repeated merges into an empty heap")
+    {
+        MinHeap<int> heap;
+        std::vector<std::pair<Handle, int>> handles;
+
+        // each shard fills more than half a block, so all handles are kept
+        for(int shard = 0; shard < 10; ++shard)
+        {
+            MinHeap<int> other;
+            fill(other, handles, shard * 1000, 600 + shard);
+            heap.merge(std::move(other));
+        }
+
+        check(heap, handles, {});
+    }
+
+    SECTION("Many merges of single elements")
+    {
+        MinHeap<int> heap;
+        std::vector<std::pair<Handle, int>> handles;
+        fill(heap, handles, 0, 100);
+
+        std::vector<int> rehandled;
+        for(int i = 0; i < 100000; ++i)
+        {
+            MinHeap<int> other;
+            Handle h = other.insert(i % 1000);
+            heap.merge(std::move(other));
+
+            REQUIRE_FALSE(heap.contains(h));
+            rehandled.push_back(i % 1000);
+        }
+
+        check(heap, handles, rehandled);
+    }
+}
+
+struct CountingCmp
+{
+    size_t* mCalls;
+
+    bool operator()(int lhs, int rhs) const
+    {
+        ++*mCalls;
+        return lhs > rhs;
+    }
+};
+
+TEST_CASE("Statistics")
+{
+    using CountingHeap = Heap<int, std::greater<int>, 2, HeapStats>;
+
+    // the default policy takes no space
+    REQUIRE(sizeof(CountingHeap) == sizeof(MinHeap<int>) + sizeof(HeapStats));
+
+    SECTION("Sifts")
+    {
+        CountingHeap heap;
+
+        // ascending values stay where they are inserted
+        for(int i = 0; i < 1023; ++i) { heap.insert(i); }
+
+        REQUIRE(heap.stats().mComparisons == 1022);
+        REQUIRE(heap.stats().mSiftUps == 1022);
+        REQUIRE(heap.stats().mSiftUpLevels == 0);
+        REQUIRE(heap.stats().mMoves == 0);
+
+        heap.insert(-1);
+        REQUIRE(heap.stats().mMaxSiftUpDepth == 10);
+        REQUIRE(heap.stats().mMoves == 11);
+
+        heap.stats().reset();
+        heap.pop();
+
+        REQUIRE(heap.stats().mSiftDowns == 1);
+        REQUIRE(heap.stats().mMaxSiftDownDepth <= 9);
+        REQUIRE(heap.stats().mSiftUps == 0);
+        REQUIRE(heap.stats().mRebuilds == 0);
+    }
+
+    SECTION("Comparisons")
+    {
+        size_t calls = 0;
+        Heap<int, CountingCmp, 4, HeapStats> heap(CountingCmp { &calls });
+        std::vector<Heap<int, CountingCmp, 4, HeapStats>::Handle> handles;
+
+        for(int i = 0; i < 2000; ++i)
+        {
+            handles.push_back(heap.insert(i * 7919 % 2003));
+        }
+
+        for(size_t i = 0; i < handles.size(); i += 3) { heap.update(handles[i], static_cast<int>(i) - 1000); }
+        for(size_t i = 1; i < handles.size(); i += 5) { heap.erase(handles[i]); }
+        for(int i = 0; i < 100; ++i) { heap.pop(); }
+
+        REQUIRE(heap.stats().mComparisons == calls);
+        REQUIRE(heap.stats().mSiftUpLevels + heap.stats().mSiftDownLevels <= heap.stats().mMoves);
+
+        // reading the values in order is not counted
+        size_t counted = calls;
+        std::vector<int> best;
+        heap.topK(50, std::back_inserter(best));
+        REQUIRE(heap.sortedValues().size() == heap.size());
+        REQUIRE(calls > counted);
+        REQUIRE(heap.stats().mComparisons == counted);
+    }
+
+    SECTION("Rebuilds")
+    {
+        std::vector<int> values;
+        for(int i = 0; i < 200000; ++i) { values.push_back(i * 7919 % 200003); }
+
+        // counted heaps are built on one thread
+        CountingHeap heap(values.begin(), values.end(), BuildThreads(4));
+        REQUIRE(heap.stats().mRebuilds == 1);
+        REQUIRE(heap.stats().mSiftDowns == values.size() / 2);
+
+        heap.insert(values.begin(), values.begin() + 5);
+        REQUIRE(heap.stats().mRebuilds == 1);
+
+        heap.insert(values.begin(), values.end());
+        REQUIRE(heap.stats().mRebuilds == 2);
+
+        CountingHeap copy(heap);
+        REQUIRE(copy.stats().mRebuilds == 2);
+
+        std::sort(values.begin(), values.end());
+        REQUIRE(toSortedVector(CountingHeap(values.rbegin(), values.rend())) == values);
+    }
+}
+
 #endif
 
 #ifdef MOVE_ONLY
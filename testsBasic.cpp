@@ -3,12 +3,14 @@
 #include <algorithm>
 #include <cstdlib>
 #include <utility>
+#include <ctime>
 #include <chrono>
+#include <string>
 #include "catch.hpp"
 #include "heap.h"
 
 #define ALLOW_TESTS
-#undef ALLOW_TESTS
+//#undef ALLOW_TESTS
 
 #ifdef ALLOW_TESTS
 
@@ -225,6 +227,23 @@ TEST_CASE("Handles stuff")
         REQUIRE(h.size() == 4);
         REQUIRE(h2.size() == 5);
     }
+
+    SECTION("Erased handle is not reused")
+    {
+        auto handle = h.topHandle();
+
+        REQUIRE(h.contains(handle));
+        REQUIRE_FALSE(h.contains(MinHeap<int>::Handle()));
+
+        h.erase(handle);
+        auto handle2 = h.insert(0);
+
+        REQUIRE_FALSE(h.contains(handle));
+        REQUIRE(h.contains(handle2));
+        REQUIRE(handle != handle2);
+        REQUIRE(h.topHandle() == handle2);
+        REQUIRE(h.size() == 5);
+    }
 }
 
 class CopyFailer
@@ -400,86 +419,197 @@ auto getDurationTime(Func f, const Data& c)
     return duration_cast<microseconds>( t2 - t1 ).count();
 }
 
-void hugeInsertion(const std::vector<int>& vct)
+// Binary min-heap with a handle position per element that sifts by swapping
+// level by level, like Heap did before the hole-based sifts. The baseline for
+// the sift benchmark.
+class SwapSiftHeap
 {
-    MinHeap<int> h;
+    std::vector<std::pair<std::string, size_t>> mData;
+    std::vector<size_t> mPos;
 
-    for(auto a : vct)
-        h.insert(a);
+    void swapAt(size_t a, size_t b)
+    {
+        std::swap(mData[a], mData[b]);
+        mPos[mData[a].second] = a;
+        mPos[mData[b].second] = b;
+    }
 
-    std::vector<int> srt = toSortedVector(h);
-    REQUIRE(std::is_sorted(srt.begin(), srt.end()));
-}
+public:
+    void insert(const std::string& value)
+    {
+        size_t index = mData.size();
+        mPos.push_back(index);
+        mData.emplace_back(value, index);
 
-void hugeCtor(const std::vector<int>& vct)
-{
-    MinHeap<int> h(vct.begin(), vct.end());
+        while(index > 0 && mData[(index - 1) / 2].first > mData[index].first)
+        {
+            swapAt(index, (index - 1) / 2);
+            index = (index - 1) / 2;
+        }
+    }
 
-    std::vector<int> srt = toSortedVector(h);
-    REQUIRE(std::is_sorted(srt.begin(), srt.end()));
-}
+    void pop()
+    {
+        swapAt(0, mData.size() - 1);
+        mData.pop_back();
 
-void updateFunction(const std::vector<int>& vctDef)
+        for(size_t index = 0;;)
+        {
+            size_t child = 2 * index + 1;
+            if(child >= mData.size()) { break; }
+            if(child + 1 < mData.size() && mData[child + 1].first < mData[child].first) { ++child; }
+            if(!(mData[child].first < mData[index].first)) { break; }
+
+            swapAt(index, child);
+            index = child;
+        }
+    }
+
+    bool empty() const
+    {
+        return mData.empty();
+    }
+};
+
+TEST_CASE("Sift benchmark", "[.][benchmark]")
 {
-    MinHeap<int> h;
-    std::vector<MinHeap<int>::Handle> handles;
-    std::vector<int> vct = vctDef;
+    // Hidden by default, run with [benchmark]. Sifts move the popped string
+    // through a hole instead of swapping it down level by level.
+    const size_t count = 1 << 20;
+    std::vector<std::string> vct;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        vct.push_back(std::string(32, 'a') + std::to_string((i * 2654435761u) % count));
+    }
+
+    auto insertPop = [](const std::vector<std::string>& data)
+    {
+        Heap<std::string, std::greater<std::string>> h;
 
-    for(auto a : vct)
-        handles.push_back(h.insert(a));
+        for(const auto& a : data)
+            h.insert(a);
 
-    for(size_t i = 0; i < vct.size(); ++i)
-        vct[i] *= -1;
+        while(!h.empty())
+            h.pop();
+    };
 
-    for(size_t i = 0; i < handles.size(); ++i)
-        h.update(handles[i], vct[i]);
+    auto swapInsertPop = [](const std::vector<std::string>& data)
+    {
+        SwapSiftHeap h;
 
-    std::sort(vct.begin(), vct.end());
-    REQUIRE(vct == toSortedVector(h));
+        for(const auto& a : data)
+            h.insert(a);
 
+        while(!h.empty())
+            h.pop();
+    };
+
+    auto time = getDurationTime(insertPop, vct);
+    auto swapTime = getDurationTime(swapInsertPop, vct);
+    std::cout << "insert + pop of " << count << " strings: " << time << " us, swapping sifts "
+              << swapTime << " us" << std::endl;
 }
 
-void insEraseFunction(const std::vector<int>& vctDef)
+template<size_t Arity>
+void arityMix(const std::vector<int>& vct)
 {
-    MinHeap<int> h;
-    std::vector<MinHeap<int>::Handle> handles;
-    std::vector<int> vct = vctDef;
+    Heap<int, std::greater<int>, Arity> h;
+    std::vector<typename Heap<int, std::greater<int>, Arity>::Handle> handles;
 
-    for(auto a : vct)
-        handles.push_back(h.insert(a));
+    auto insTime = getDurationTime([&](const std::vector<int>& data)
+    {
+        for(auto a : data)
+            handles.push_back(h.insert(a));
+    }, vct);
+
+    auto updTime = getDurationTime([&](const std::vector<int>& data)
+    {
+        for(size_t i = 0; i < handles.size(); ++i)
+            h.update(handles[i], data[i] / 2 - 1);
+    }, vct);
 
-    for(size_t i = 0; i < vct.size(); ++i)
-        vct[i] *= -1;
+    auto popTime = getDurationTime([&](const std::vector<int>&)
+    {
+        while(!h.empty())
+            h.pop();
+    }, vct);
 
-    for(size_t i = 0; i < handles.size(); ++i)
-        h.erase(handles[i]);
+    std::cout << "arity " << Arity << ": insert " << insTime << " us, update "
+              << updTime << " us, pop " << popTime << " us" << std::endl;
+}
 
-    for(auto a : vct)
-        h.insert(a);
+TEST_CASE("Arity benchmark", "[.][benchmark]")
+{
+    const size_t count = 1 << 21;
+    std::vector<int> vct;
 
-    std::sort(vct.begin(), vct.end());
-    REQUIRE(vct == toSortedVector(h));
+    for(size_t i = 0; i < count; ++i)
+    {
+        vct.push_back(static_cast<int>((i * 2654435761u) % count));
+    }
 
+    arityMix<2>(vct);
+    arityMix<4>(vct);
+    arityMix<8>(vct);
+    arityMix<16>(vct);
 }
 
-TEST_CASE("Time measure")
+TEST_CASE("Parallel build benchmark", "[.][benchmark]")
 {
-    SECTION("Insert vs ctor")
+    const size_t count = 1 << 25;
+    std::vector<int> vct;
+
+    for(size_t i = 0; i < count; ++i)
     {
-        for(size_t cnt = 523; cnt<1024; cnt+=100)
+        vct.push_back(static_cast<int>((i * 2654435761u) % count));
+    }
+
+    auto serialTime = getDurationTime([](const std::vector<int>& data)
+    {
+        MinHeap<int> h(data.begin(), data.end(), BuildThreads(1));
+    }, vct);
+
+    for(size_t threads = 1; threads <= 32; threads *= 2)
+    {
+        auto time = getDurationTime([threads](const std::vector<int>& data)
         {
-            std::vector<int> vct;
-            for(size_t i = cnt * cnt; i>0; --i)
-            {
-                vct.push_back(i);
-            }
+            MinHeap<int> h(data.begin(), data.end(), BuildThreads(threads));
+        }, vct);
 
-            auto insTime = getDurationTime(hugeInsertion, vct);
-            auto ctorTime = getDurationTime(hugeCtor, vct);
+        std::cout << "build of " << count << " ints on " << threads << " threads: " << time
+                  << " us, speedup " << static_cast<double>(serialTime) / time << std::endl;
+    }
+}
 
-            REQUIRE(ctorTime < insTime);
-        }
+TEST_CASE("Sorted export benchmark", "[.][benchmark]")
+{
+    const size_t count = 1 << 22;
+    std::vector<int> vct;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        vct.push_back(static_cast<int>((i * 2654435761u) % count));
     }
+
+    MinHeap<int> heap(vct.begin(), vct.end());
+
+    auto popTime = getDurationTime([](const MinHeap<int>& h)
+    {
+        MinHeap<int> copy = h;
+        std::vector<int> result;
+
+        while(!copy.empty())
+            result.push_back(copy.extractTop());
+    }, heap);
+
+    auto sortTime = getDurationTime([](const MinHeap<int>& h)
+    {
+        std::vector<int> result = toSortedVector(h);
+    }, heap);
+
+    std::cout << "sorted export of " << count << " ints: popping a copy " << popTime
+              << " us, toSortedVector " << sortTime << " us" << std::endl;
 }
 
 TEST_CASE("Priority queue")
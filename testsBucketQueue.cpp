@@ -0,0 +1,134 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <random>
+#include <stdexcept>
+#include "catch.hpp"
+#include "heap.h"
+#include "bucketqueue.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all BucketQueue functions instantiate at least for int.
+template class BucketQueue< int >;
+
+TEST_CASE( "Bucket queue basics" ) {
+    BucketQueue< std::string > queue;
+
+    REQUIRE( queue.empty() );
+    queue.pop();
+    queue.erase( BucketQueue< std::string >::Handle() );
+
+    auto low = queue.insert( { 3, "low" } );
+    auto first = queue.insert( { 200, "first" } );
+    auto second = queue.insert( { 200, "second" } );
+    auto top = queue.insert( { 255, "top" } );
+
+    REQUIRE( queue.size() == 4 );
+    REQUIRE( queue.topHandle() == top );
+
+    SECTION( "equal priorities are served in insertion order" ) {
+        queue.pop();
+        REQUIRE( queue.topHandle() == first );
+        queue.pop();
+        REQUIRE( queue.topHandle() == second );
+        queue.pop();
+        REQUIRE( queue.topHandle() == low );
+        queue.pop();
+        REQUIRE( queue.empty() );
+        REQUIRE_FALSE( queue.contains( low ) );
+    }
+    SECTION( "update" ) {
+        queue.update( low, { 255, "raised" } );
+        queue.update( top, { 0, "lowered" } );
+        REQUIRE( queue.topHandle() == low );
+        REQUIRE( queue.get( top ).second == "lowered" );
+
+        std::vector< std::pair< unsigned, std::string > > expected = {
+            { 255, "raised" }, { 200, "first" }, { 200, "second" }, { 0, "lowered" } };
+        REQUIRE( toSortedVector( queue ) == expected );
+    }
+    SECTION( "erase" ) {
+        queue.erase( first );
+        queue.erase( top );
+        REQUIRE( queue.topHandle() == second );
+        REQUIRE( queue.get( low ).second == "low" );
+        REQUIRE( queue.size() == 2 );
+    }
+    SECTION( "priorities above MaxPriority throw" ) {
+        REQUIRE_THROWS_AS( queue.insert( { 256, "over" } ), const std::out_of_range& );
+        REQUIRE_THROWS_AS( queue.update( low, { 1000, "over" } ), const std::out_of_range& );
+        REQUIRE( queue.size() == 4 );
+        REQUIRE( queue.get( low ).second == "low" );
+        REQUIRE( queue.topHandle() == top );
+    }
+    SECTION( "move and swap keep handles" ) {
+        BucketQueue< std::string > moved = std::move( queue );
+        BucketQueue< std::string > other;
+        swap( moved, other );
+        REQUIRE( other.topHandle() == top );
+        REQUIRE( other.get( second ).second == "second" );
+        REQUIRE( moved.empty() );
+    }
+}
+
+TEST_CASE( "Bucket queue against PriorityQueue" ) {
+    std::mt19937 randgen;
+    BucketQueue< int, 1000 > bucket;
+    PriorityQueue< unsigned, int > reference;
+    std::vector< std::pair< BucketQueue< int, 1000 >::Handle, PriorityQueue< unsigned, int >::Handle > > handles;
+
+    // the value is the index of the element's handles, so the element popped
+    // from the bucket queue can be erased from the reference even when more
+    // elements have the same priority
+    for ( int i = 0; i < 50000; ++i ) {
+        unsigned priority = randgen() % 1001;
+
+        switch ( randgen() % 4 ) {
+            case 0:
+            case 1: {
+                std::pair< unsigned, int > value( priority, static_cast< int >( handles.size() ) );
+                handles.emplace_back( bucket.insert( value ), reference.insert( value ) );
+                break;
+            }
+            case 2:
+                if ( !reference.empty() ) {
+                    REQUIRE( bucket.top().first == reference.top().first );
+                    reference.erase( handles[ bucket.top().second ].second );
+                    bucket.pop();
+                }
+                break;
+            case 3: {
+                if ( handles.empty() )
+                    break;
+                int index = static_cast< int >( randgen() % handles.size() );
+                auto &h = handles[ index ];
+                if ( !bucket.contains( h.first ) )
+                    break;
+                if ( i % 2 ) {
+                    bucket.update( h.first, { priority, index } );
+                    reference.update( h.second, { priority, index } );
+                } else {
+                    bucket.erase( h.first );
+                    reference.erase( h.second );
+                }
+                break;
+            }
+        }
+
+        REQUIRE( bucket.size() == reference.size() );
+    }
+
+    while ( !reference.empty() ) {
+        REQUIRE( bucket.top().first == reference.top().first );
+        bucket.pop();
+        reference.pop();
+    }
+}
+
+#endif
@@ -0,0 +1,341 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "catch.hpp"
+#include "heap.h"
+#include "concurrentheap.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all ConcurrentHeap functions instantiate at least for int.
+template class ConcurrentHeap< int, std::greater< int > >;
+
+using ConcurrentMinHeap = ConcurrentHeap< int, std::greater< int > >;
+
+std::vector< int > drain( ConcurrentMinHeap &heap ) {
+    std::vector< int > result;
+    int value;
+    while ( heap.pop( value ) )
+        result.push_back( value );
+    return result;
+}
+
+TEST_CASE( "Concurrent heap basics" ) {
+    ConcurrentMinHeap heap;
+    int value = 0;
+
+    REQUIRE( heap.empty() );
+    REQUIRE_FALSE( heap.pop() );
+    REQUIRE_FALSE( heap.top( value ) );
+    REQUIRE_FALSE( heap.erase( ConcurrentMinHeap::Handle() ) );
+
+    auto five = heap.insert( 5 );
+    auto three = heap.insert( 3 );
+    auto eight = heap.insert( 8 );
+    auto one = heap.insert( 1 );
+
+    REQUIRE( heap.size() == 4 );
+    REQUIRE( heap.top( value ) );
+    REQUIRE( value == 1 );
+    REQUIRE( heap.get( eight, value ) );
+    REQUIRE( value == 8 );
+
+    SECTION( "pop" ) {
+        std::vector< int > expected = { 1, 3, 5, 8 };
+        REQUIRE( drain( heap ) == expected );
+        REQUIRE_FALSE( heap.contains( one ) );
+    }
+    SECTION( "update" ) {
+        REQUIRE( heap.update( eight, 0 ) );
+        REQUIRE( heap.update( one, 9 ) );
+        REQUIRE( heap.get( one, value ) );
+        REQUIRE( value == 9 );
+
+        std::vector< int > expected = { 0, 3, 5, 9 };
+        REQUIRE( drain( heap ) == expected );
+        REQUIRE_FALSE( heap.update( one, 2 ) );
+    }
+    SECTION( "erase" ) {
+        REQUIRE( heap.erase( three ) );
+        REQUIRE_FALSE( heap.erase( three ) );
+        REQUIRE_FALSE( heap.contains( three ) );
+        REQUIRE( heap.contains( five ) );
+
+        std::vector< int > expected = { 1, 5, 8 };
+        REQUIRE( drain( heap ) == expected );
+    }
+}
+
+TEST_CASE( "Concurrent heap against Heap" ) {
+    std::mt19937 randgen;
+    ConcurrentMinHeap concurrent;
+    MinHeap< int > reference;
+    std::vector< std::pair< ConcurrentMinHeap::Handle, MinHeap< int >::Handle > > handles;
+
+    for ( int i = 0; i < 20000; ++i ) {
+        int value = static_cast< int >( randgen() % 1000 );
+
+        switch ( randgen() % 4 ) {
+            case 0:
+            case 1:
+                handles.emplace_back( concurrent.insert( value ), reference.insert( value ) );
+                break;
+            case 2: {
+                int top;
+                REQUIRE( concurrent.pop( top ) == !reference.empty() );
+                if ( !reference.empty() ) {
+                    REQUIRE( top == reference.top() );
+                    reference.pop();
+                }
+                break;
+            }
+            case 3: {
+                if ( handles.empty() )
+                    break;
+                auto &h = handles[ randgen() % handles.size() ];
+                REQUIRE( concurrent.contains( h.first ) == reference.contains( h.second ) );
+                if ( !reference.contains( h.second ) )
+                    break;
+                if ( i % 2 ) {
+                    concurrent.update( h.first, value );
+                    reference.update( h.second, value );
+                } else {
+                    concurrent.erase( h.first );
+                    reference.erase( h.second );
+                }
+                break;
+            }
+        }
+
+        REQUIRE( concurrent.size() == reference.size() );
+    }
+
+    REQUIRE( drain( concurrent ) == toSortedVector( reference ) );
+}
+
+TEST_CASE( "Concurrent heap under contention" ) {
+    const int threadCount = 8;
+    const int perThread = 20000;
+    ConcurrentMinHeap heap;
+
+    SECTION( "insert and pop" ) {
+        std::vector< std::vector< int > > popped( threadCount );
+        std::vector< std::thread > threads;
+
+        for ( int t = 0; t < threadCount; ++t ) {
+            threads.emplace_back( [&, t] {
+                std::mt19937 randgen( t );
+                for ( int i = 0; i < perThread; ++i ) {
+                    heap.insert( static_cast< int >( randgen() % 100000 ) * threadCount + t );
+                    int value;
+                    if ( i % 3 == 0 && heap.pop( value ) )
+                        popped[ t ].push_back( value );
+                }
+            } );
+        }
+        for ( auto &thread : threads )
+            thread.join();
+
+        std::vector< int > rest = drain( heap );
+        REQUIRE( std::is_sorted( rest.begin(), rest.end() ) );
+
+        std::vector< int > all = rest, expected;
+        for ( auto &values : popped )
+            all.insert( all.end(), values.begin(), values.end() );
+        for ( int t = 0; t < threadCount; ++t ) {
+            std::mt19937 randgen( t );
+            for ( int i = 0; i < perThread; ++i )
+                expected.push_back( static_cast< int >( randgen() % 100000 ) * threadCount + t );
+        }
+        std::sort( all.begin(), all.end() );
+        std::sort( expected.begin(), expected.end() );
+        REQUIRE( all == expected );
+    }
+    SECTION( "update and erase" ) {
+        std::vector< std::vector< int > > kept( threadCount );
+        std::vector< std::thread > threads;
+
+        for ( int t = 0; t < threadCount; ++t ) {
+            threads.emplace_back( [&, t] {
+                std::mt19937 randgen( t );
+                std::vector< std::pair< ConcurrentMinHeap::Handle, int > > own;
+                for ( int i = 0; i < perThread; ++i ) {
+                    int value = static_cast< int >( randgen() % 100000 );
+                    if ( own.empty() || randgen() % 3 == 0 ) {
+                        own.emplace_back( heap.insert( value ), value );
+                        continue;
+                    }
+                    size_t index = randgen() % own.size();
+                    if ( randgen() % 2 ) {
+                        heap.update( own[ index ].first, value );
+                        own[ index ].second = value;
+                    } else {
+                        heap.erase( own[ index ].first );
+                        own[ index ] = own.back();
+                        own.pop_back();
+                    }
+                }
+                for ( auto &element : own )
+                    kept[ t ].push_back( element.second );
+            } );
+        }
+        for ( auto &thread : threads )
+            thread.join();
+
+        std::vector< int > expected;
+        for ( auto &values : kept )
+            expected.insert( expected.end(), values.begin(), values.end() );
+        std::sort( expected.begin(), expected.end() );
+        REQUIRE( drain( heap ) == expected );
+    }
+}
+
+TEST_CASE( "Concurrent heap pop during update" ) {
+    // pop takes the last element before it locks the root, an update of the
+    // root in between must not make pop return anything but the minimum
+    for ( int round = 0; round < 2000; ++round ) {
+        ConcurrentMinHeap heap;
+        auto one = heap.insert( 1 );
+        heap.insert( 10 );
+        heap.insert( 5 );
+
+        std::atomic< int > ready( 0 );
+        int popped = 0;
+        std::thread popper( [&] {
+            ++ready;
+            while ( ready != 2 )
+                std::this_thread::yield();
+            heap.pop( popped );
+        } );
+        ++ready;
+        while ( ready != 2 )
+            std::this_thread::yield();
+        bool updated = heap.update( one, 100 );
+        popper.join();
+
+        std::vector< int > rest = drain( heap );
+        if ( updated ) {
+            REQUIRE( popped == 5 );
+            REQUIRE( rest == std::vector< int >( { 10, 100 } ) );
+        } else {
+            REQUIRE( popped == 1 );
+            REQUIRE( rest == std::vector< int >( { 5, 10 } ) );
+        }
+    }
+}
+
+TEST_CASE( "Concurrent heap pop during erase" ) {
+    // when a pop takes the element first, erase puts the last element back,
+    // where the sift down of the pop may have skipped it
+    for ( int round = 0; round < 2000; ++round ) {
+        ConcurrentMinHeap heap;
+        auto zero = heap.insert( 0 );
+        heap.insert( 3 );
+        heap.insert( 1 );
+        heap.insert( 5 );
+
+        std::atomic< int > ready( 0 );
+        int popped = -1;
+        std::thread popper( [&] {
+            ++ready;
+            while ( ready != 2 )
+                std::this_thread::yield();
+            heap.pop( popped );
+        } );
+        ++ready;
+        while ( ready != 2 )
+            std::this_thread::yield();
+        bool erased = heap.erase( zero );
+        popper.join();
+
+        int top = -1;
+        REQUIRE( heap.top( top ) );
+        std::vector< int > rest = drain( heap );
+        REQUIRE( std::is_sorted( rest.begin(), rest.end() ) );
+        REQUIRE( top == rest.front() );
+        if ( erased ) {
+            REQUIRE( popped == 1 );
+            REQUIRE( rest == std::vector< int >( { 3, 5 } ) );
+        } else {
+            REQUIRE( popped == 0 );
+            REQUIRE( rest == std::vector< int >( { 1, 3, 5 } ) );
+        }
+    }
+}
+
+// Heap behind one mutex, the baseline for the benchmark.
+class LockedHeap {
+    MinHeap< int > mHeap;
+    std::mutex mLock;
+
+public:
+    void insert( int value ) {
+        std::lock_guard< std::mutex > guard( mLock );
+        mHeap.insert( value );
+    }
+
+    bool pop( int &value ) {
+        std::lock_guard< std::mutex > guard( mLock );
+        if ( mHeap.empty() )
+            return false;
+        value = mHeap.extractTop();
+        return true;
+    }
+};
+
+// Operations per microsecond of threadCount threads doing alternating
+// inserts and pops on a heap prefilled with prefill elements.
+template< typename HeapType >
+double throughput( int threadCount, int prefill, int operations ) {
+    HeapType heap;
+    std::mt19937 randgen;
+    for ( int i = 0; i < prefill; ++i )
+        heap.insert( static_cast< int >( randgen() ) );
+
+    std::vector< std::thread > threads;
+    auto start = std::chrono::steady_clock::now();
+    for ( int t = 0; t < threadCount; ++t ) {
+        threads.emplace_back( [&, t] {
+            std::mt19937 threadgen( t );
+            int value;
+            for ( int i = 0; i < operations / threadCount; ++i ) {
+                if ( i % 2 )
+                    heap.pop( value );
+                else
+                    heap.insert( static_cast< int >( threadgen() ) );
+            }
+        } );
+    }
+    for ( auto &thread : threads )
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+
+    return operations / static_cast< double >(
+        std::chrono::duration_cast< std::chrono::microseconds >( end - start ).count() );
+}
+
+TEST_CASE( "Concurrent heap benchmark", "[.][benchmark]" ) {
+    const int prefill = 1 << 20;
+    const int operations = 1 << 22;
+
+    for ( int threadCount = 1; threadCount <= 64; threadCount *= 2 ) {
+        std::cout << threadCount << " threads: ConcurrentHeap "
+                  << throughput< ConcurrentMinHeap >( threadCount, prefill, operations )
+                  << " ops/us, locked Heap "
+                  << throughput< LockedHeap >( threadCount, prefill, operations )
+                  << " ops/us" << std::endl;
+    }
+}
+
+#endif
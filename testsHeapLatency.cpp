@@ -0,0 +1,159 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <limits>
+#include <functional>
+#include "catch.hpp"
+#include "heap.h"
+#include "heaplatency.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Tick source advancing by sStep on every read, so every timed operation
+// takes exactly sStep ticks.
+struct StepTicks {
+    static std::uint64_t sNow;
+    static std::uint64_t sStep;
+
+    static std::uint64_t now() {
+        return sNow += sStep;
+    }
+};
+
+std::uint64_t StepTicks::sNow = 0;
+std::uint64_t StepTicks::sStep = 1;
+
+// Test that all Heap functions instantiate with the latency policy.
+template class Heap< int, std::greater< int >, 2, HeapLatencyStats< StepTicks > >;
+
+using TimedHeap = Heap< int, std::greater< int >, 2, HeapLatencyStats< StepTicks > >;
+
+TEST_CASE( "Latency histogram" ) {
+    LatencyHistogram histogram;
+
+    REQUIRE( histogram.getCount() == 0 );
+    REQUIRE( histogram.getPercentile( 0.5 ) == 0 );
+
+    SECTION( "small values are exact" ) {
+        for ( std::uint64_t i = 1; i <= 10; ++i )
+            histogram.record( i );
+
+        REQUIRE( histogram.getCount() == 10 );
+        REQUIRE( histogram.getMean() == 5.5 );
+        REQUIRE( histogram.getPercentile( 0.5 ) == 5 );
+        REQUIRE( histogram.getPercentile( 0.9 ) == 9 );
+        REQUIRE( histogram.getPercentile( 1 ) == 10 );
+        REQUIRE( histogram.getMax() == 10 );
+    }
+    SECTION( "large values are within 1/16" ) {
+        for ( std::uint64_t i = 1; i <= 100000; ++i )
+            histogram.record( i * 1000 );
+
+        for ( double fraction : { 0.5, 0.9, 0.99, 0.999 } ) {
+            double exact = fraction * 100000 * 1000;
+            double value = static_cast< double >( histogram.getPercentile( fraction ) );
+            REQUIRE( value >= exact );
+            REQUIRE( value <= exact * 17 / 16 );
+        }
+        REQUIRE( histogram.getPercentile( 1 ) == 100000000 );
+    }
+    SECTION( "huge values share the last bucket" ) {
+        histogram.record( 1 );
+        histogram.record( std::uint64_t( 1 ) << 50 );
+        histogram.record( std::numeric_limits< std::uint64_t >::max() );
+
+        REQUIRE( histogram.getPercentile( 0.3 ) == 1 );
+        REQUIRE( histogram.getPercentile( 0.6 ) == histogram.getMax() );
+    }
+    SECTION( "add" ) {
+        LatencyHistogram other;
+        histogram.record( 100 );
+        other.record( 3 );
+        other.record( 5000 );
+        histogram.add( other );
+
+        REQUIRE( histogram.getCount() == 3 );
+        REQUIRE( histogram.getPercentile( 0.1 ) == 3 );
+        REQUIRE( histogram.getMax() == 5000 );
+
+        histogram.reset();
+        REQUIRE( histogram.getCount() == 0 );
+        REQUIRE( histogram.getMax() == 0 );
+    }
+}
+
+TEST_CASE( "Heap latency statistics" ) {
+    StepTicks::sStep = 7;
+    TimedHeap heap;
+    std::vector< TimedHeap::Handle > handles;
+
+    for ( int i = 0; i < 1000; ++i )
+        handles.push_back( heap.insert( i * 7919 % 1009 ) );
+    for ( int i = 0; i < 100; ++i )
+        heap.update( handles[ i ], -i );
+    for ( int i = 100; i < 150; ++i )
+        heap.promote( handles[ i ], -1000 - i );
+    for ( int i = 500; i < 530; ++i )
+        heap.erase( handles[ i ] );
+    heap.extract( handles[ 600 ] );
+    for ( int i = 0; i < 20; ++i )
+        heap.pop();
+    heap.extractTop();
+
+    auto &stats = heap.stats();
+    const LatencyHistogram &insert = stats.getHistogram( HeapOperation::Insert );
+
+    REQUIRE( insert.getCount() == 1000 );
+    REQUIRE( insert.getPercentile( 0.99 ) == 7 );
+    REQUIRE( insert.getMax() == 7 );
+    REQUIRE( stats.getHistogram( HeapOperation::Update ).getCount() == 150 );
+    REQUIRE( stats.getHistogram( HeapOperation::Erase ).getCount() == 31 );
+    REQUIRE( stats.getHistogram( HeapOperation::Pop ).getCount() == 21 );
+
+    std::ostringstream out;
+    stats.writePercentiles( out );
+    REQUIRE( out.str().find( "\"insert\": { \"count\": 1000, \"mean\": 7, \"p50\": 7" ) != std::string::npos );
+    REQUIRE( out.str().find( "\"pop\": { \"count\": 21" ) != std::string::npos );
+
+    SECTION( "sampling" ) {
+        stats.reset();
+        stats.setSampleInterval( 8 );
+
+        for ( int i = 0; i < 800; ++i )
+            heap.insert( i );
+
+        REQUIRE( stats.getHistogram( HeapOperation::Insert ).getCount() == 100 );
+        REQUIRE( stats.getHistogram( HeapOperation::Pop ).getCount() == 0 );
+    }
+    SECTION( "bulk operations are not timed" ) {
+        stats.reset();
+        std::vector< int > values( 100, 5 );
+        heap.insert( values.begin(), values.end() );
+        heap.erase_if( []( int value ) { return value == 5; } );
+
+        REQUIRE( stats.getHistogram( HeapOperation::Insert ).getCount() == 0 );
+        REQUIRE( stats.getHistogram( HeapOperation::Erase ).getCount() == 0 );
+    }
+}
+
+TEST_CASE( "Heap latency on the steady clock" ) {
+    Heap< int, std::greater< int >, 4, HeapLatencyStats<> > heap;
+
+    for ( int i = 0; i < 10000; ++i )
+        heap.insert( i * 7919 % 10007 );
+    while ( !heap.empty() )
+        heap.pop();
+
+    const LatencyHistogram &pop = heap.stats().getHistogram( HeapOperation::Pop );
+    REQUIRE( pop.getCount() == 10000 );
+    REQUIRE( pop.getPercentile( 0.5 ) <= pop.getPercentile( 0.99 ) );
+    REQUIRE( pop.getPercentile( 0.99 ) <= pop.getMax() );
+}
+
+#endif
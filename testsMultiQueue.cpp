@@ -0,0 +1,202 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include "catch.hpp"
+#include "heap.h"
+#include "multiqueue.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all MultiQueue functions instantiate at least for int.
+template class MultiQueue< int, std::greater< int > >;
+
+using MinMultiQueue = MultiQueue< int, std::greater< int > >;
+
+// Fenwick tree counting the keys 0..n-1 still in the queue, for the rank of
+// a popped key among them.
+class RankCounter {
+    std::vector< int > mTree;
+
+public:
+    explicit RankCounter( size_t n ) : mTree( n + 1 ) {}
+
+    void add( int key, int delta ) {
+        for ( size_t i = key + 1; i < mTree.size(); i += i & ( 0 - i ) )
+            mTree[ i ] += delta;
+    }
+
+    // number of keys smaller than key
+    int rank( int key ) const {
+        int result = 0;
+        for ( size_t i = key; i > 0; i -= i & ( 0 - i ) )
+            result += mTree[ i ];
+        return result;
+    }
+};
+
+// Pops all of keys 0..n-1 one by one and returns the mean and the maximum
+// rank of the popped keys.
+std::pair< double, int > rankError( MinMultiQueue &queue, int n ) {
+    RankCounter counter( n );
+    std::vector< int > keys( n );
+    for ( int i = 0; i < n; ++i )
+        keys[ i ] = i;
+    std::shuffle( keys.begin(), keys.end(), std::mt19937() );
+    for ( int key : keys ) {
+        queue.insert( key );
+        counter.add( key, 1 );
+    }
+
+    double sum = 0;
+    int maximum = 0;
+    int key;
+    while ( queue.pop( key ) ) {
+        int rank = counter.rank( key );
+        sum += rank;
+        maximum = std::max( maximum, rank );
+        counter.add( key, -1 );
+    }
+    return std::make_pair( sum / n, maximum );
+}
+
+TEST_CASE( "Multi queue basics" ) {
+    int value;
+
+    SECTION( "one queue is exact" ) {
+        MinMultiQueue queue( 1, 1 );
+        REQUIRE( queue.queueCount() == 1 );
+        REQUIRE_FALSE( queue.pop( value ) );
+
+        std::vector< int > values = { 5, 3, 9, 1, 7 }, popped;
+        for ( int v : values )
+            queue.insert( v );
+        REQUIRE( queue.size() == 5 );
+
+        while ( queue.pop( value ) )
+            popped.push_back( value );
+        std::sort( values.begin(), values.end() );
+        REQUIRE( popped == values );
+        REQUIRE( queue.empty() );
+    }
+    SECTION( "relaxed order" ) {
+        MinMultiQueue queue( 4, 2 );
+        REQUIRE( queue.queueCount() == 8 );
+
+        auto error = rankError( queue, 20000 );
+        REQUIRE( queue.empty() );
+        REQUIRE( error.first < 8 * 4 );
+    }
+}
+
+TEST_CASE( "Multi queue under contention" ) {
+    const int threadCount = 8;
+    const int perThread = 20000;
+    MinMultiQueue queue( threadCount );
+    std::vector< std::vector< int > > popped( threadCount );
+    std::vector< std::thread > threads;
+
+    for ( int t = 0; t < threadCount; ++t ) {
+        threads.emplace_back( [&, t] {
+            for ( int i = 0; i < perThread; ++i ) {
+                queue.insert( i * threadCount + t );
+                int value;
+                if ( i % 2 && queue.pop( value ) )
+                    popped[ t ].push_back( value );
+            }
+        } );
+    }
+    for ( auto &thread : threads )
+        thread.join();
+
+    std::vector< int > all;
+    int value;
+    while ( queue.pop( value ) )
+        all.push_back( value );
+    for ( auto &values : popped )
+        all.insert( all.end(), values.begin(), values.end() );
+
+    std::sort( all.begin(), all.end() );
+    REQUIRE( all.size() == size_t( threadCount * perThread ) );
+    for ( size_t i = 0; i < all.size(); ++i )
+        REQUIRE( all[ i ] == static_cast< int >( i ) );
+}
+
+// Heap behind one mutex, the baseline for the benchmark.
+class MutexGuardedHeap {
+    MinHeap< int > mHeap;
+    std::mutex mLock;
+
+public:
+    void insert( int value ) {
+        std::lock_guard< std::mutex > guard( mLock );
+        mHeap.insert( value );
+    }
+
+    bool pop( int &value ) {
+        std::lock_guard< std::mutex > guard( mLock );
+        if ( mHeap.empty() )
+            return false;
+        value = mHeap.extractTop();
+        return true;
+    }
+};
+
+// Operations per microsecond of threadCount threads doing alternating
+// inserts and pops on a queue prefilled with prefill elements.
+template< typename QueueType >
+double multiQueueThroughput( QueueType &queue, int threadCount, int prefill, int operations ) {
+    std::mt19937 randgen;
+    for ( int i = 0; i < prefill; ++i )
+        queue.insert( static_cast< int >( randgen() >> 1 ) );
+
+    std::vector< std::thread > threads;
+    auto start = std::chrono::steady_clock::now();
+    for ( int t = 0; t < threadCount; ++t ) {
+        threads.emplace_back( [&, t] {
+            std::mt19937 threadgen( t );
+            int value;
+            for ( int i = 0; i < operations / threadCount; ++i ) {
+                if ( i % 2 )
+                    queue.pop( value );
+                else
+                    queue.insert( static_cast< int >( threadgen() >> 1 ) );
+            }
+        } );
+    }
+    for ( auto &thread : threads )
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+
+    return operations / static_cast< double >(
+        std::chrono::duration_cast< std::chrono::microseconds >( end - start ).count() );
+}
+
+TEST_CASE( "Multi queue benchmark", "[.][benchmark]" ) {
+    const int prefill = 1 << 20;
+    const int operations = 1 << 22;
+
+    for ( int threadCount = 1; threadCount <= 64; threadCount *= 2 ) {
+        MinMultiQueue queue( threadCount );
+        MutexGuardedHeap heap;
+        double queueThroughput = multiQueueThroughput( queue, threadCount, prefill, operations );
+        double heapThroughput = multiQueueThroughput( heap, threadCount, prefill, operations );
+
+        MinMultiQueue ranked( threadCount );
+        auto error = rankError( ranked, 1 << 20 );
+
+        std::cout << threadCount << " threads: MultiQueue " << queueThroughput << " ops/us, rank error mean "
+                  << error.first << " max " << error.second << ", locked Heap " << heapThroughput
+                  << " ops/us, rank error 0" << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include "catch.hpp"
+#include "heap.h"
+#include "pairingheap.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all PairingHeap functions instantiate at least for int.
+template class PairingHeap< int, std::less< int > >;
+
+TEST_CASE( "Pairing heap basics" ) {
+    MinPairingHeap< int > heap = { 7, 4, 2, 9, 15, 3, 6 };
+
+    REQUIRE( heap.size() == 7 );
+    REQUIRE( heap.top() == 2 );
+    REQUIRE( heap.get( heap.topHandle() ) == 2 );
+
+    SECTION( "pop" ) {
+        heap.pop();
+        REQUIRE( heap.top() == 3 );
+        REQUIRE( toSortedVector( heap ) == std::vector< int >( { 3, 4, 6, 7, 9, 15 } ) );
+    }
+    SECTION( "copy" ) {
+        MinPairingHeap< int > copy = heap;
+        copy.pop();
+        REQUIRE( copy.size() == 6 );
+        REQUIRE( heap.size() == 7 );
+        REQUIRE( toSortedVector( heap ) == std::vector< int >( { 2, 3, 4, 6, 7, 9, 15 } ) );
+    }
+    SECTION( "move and swap keep handles" ) {
+        auto h = heap.insert( 1 );
+        MinPairingHeap< int > moved = std::move( heap );
+        REQUIRE( moved.topHandle() == h );
+
+        MinPairingHeap< int > other = { 5 };
+        swap( moved, other );
+        REQUIRE( other.get( h ) == 1 );
+        REQUIRE( moved.top() == 5 );
+    }
+    SECTION( "empty" ) {
+        MinPairingHeap< int > empty;
+        empty.pop();
+        empty.update( MinPairingHeap< int >::Handle(), 3 );
+        empty.erase( MinPairingHeap< int >::Handle() );
+        REQUIRE( empty.empty() );
+        REQUIRE_FALSE( empty.contains( MinPairingHeap< int >::Handle() ) );
+    }
+}
+
+TEST_CASE( "Pairing heap against Heap" ) {
+    std::mt19937 randgen;
+    MinPairingHeap< int > pairing;
+    MinHeap< int > binary;
+    std::vector< std::pair< MinPairingHeap< int >::Handle, MinHeap< int >::Handle > > handles;
+
+    for ( int round = 0; round < 20000; ++round ) {
+        int value = randgen() % 100000;
+
+        switch ( randgen() % 6 ) {
+            case 0:
+            case 1:
+                handles.emplace_back( pairing.insert( value ), binary.insert( value ) );
+                break;
+            case 2:
+                if ( !handles.empty() ) {
+                    auto &h = handles[ randgen() % handles.size() ];
+                    pairing.update( h.first, value );
+                    binary.update( h.second, value );
+                }
+                break;
+            case 3:
+                if ( !handles.empty() ) {
+                    auto &h = handles[ randgen() % handles.size() ];
+                    int promoted = std::min( value, pairing.get( h.first ) );
+                    pairing.promote( h.first, promoted );
+                    binary.promote( h.second, promoted );
+                }
+                break;
+            case 4:
+                if ( !handles.empty() ) {
+                    size_t i = randgen() % handles.size();
+                    REQUIRE( pairing.extract( handles[ i ].first ) == binary.get( handles[ i ].second ) );
+                    binary.erase( handles[ i ].second );
+                    REQUIRE_FALSE( pairing.contains( handles[ i ].first ) );
+                    handles.erase( handles.begin() + i );
+                }
+                break;
+            case 5:
+                if ( !pairing.empty() ) {
+                    REQUIRE( pairing.top() == binary.top() );
+                    REQUIRE( pairing.get( pairing.topHandle() ) == pairing.top() );
+                }
+                break;
+        }
+
+        REQUIRE( pairing.size() == binary.size() );
+    }
+
+    REQUIRE( toSortedVector( pairing ) == toSortedVector( binary ) );
+}
+
+TEST_CASE( "Pairing heap move only" ) {
+    PairingHeap< std::unique_ptr< std::string >, std::function< bool( const std::unique_ptr< std::string > &,
+                                                                      const std::unique_ptr< std::string > & ) > >
+        heap( []( const std::unique_ptr< std::string > &a, const std::unique_ptr< std::string > &b ) {
+            return *a > *b;
+        } );
+
+    heap.emplace( new std::string( "b" ) );
+    heap.insert( std::unique_ptr< std::string >( new std::string( "a" ) ) );
+    heap.emplace( new std::string( "c" ) );
+
+    REQUIRE( *heap.extractTop() == "a" );
+
+    auto sorted = toSortedVector( std::move( heap ) );
+    REQUIRE( sorted.size() == 2 );
+    REQUIRE( *sorted[ 0 ] == "b" );
+    REQUIRE( *sorted[ 1 ] == "c" );
+}
+
+// Counts the live instances and throws from the copy constructor once
+// copiesLeft reaches zero.
+struct ThrowingCopy {
+    static int live;
+    static int copiesLeft;
+    int value;
+
+    explicit ThrowingCopy( int v ) : value( v ) { ++live; }
+    ThrowingCopy( const ThrowingCopy &o ) : value( o.value ) {
+        if ( copiesLeft-- == 0 )
+            throw std::runtime_error( "copy" );
+        ++live;
+    }
+    ~ThrowingCopy() { --live; }
+
+    bool operator<( const ThrowingCopy &o ) const { return value < o.value; }
+};
+
+int ThrowingCopy::live = 0;
+int ThrowingCopy::copiesLeft = std::numeric_limits< int >::max();
+
+TEST_CASE( "Pairing heap throwing copy" ) {
+    using ThrowingHeap = PairingHeap< ThrowingCopy, std::less< ThrowingCopy > >;
+    std::vector< ThrowingCopy > values;
+    for ( int i = 0; i < 10; ++i )
+        values.emplace_back( i );
+    ThrowingHeap heap( values.begin(), values.end() );
+    REQUIRE( ThrowingCopy::live == 20 );
+
+    SECTION( "copy constructor" ) {
+        ThrowingCopy::copiesLeft = 5;
+        REQUIRE_THROWS( ThrowingHeap{ heap } );
+    }
+    SECTION( "iterator constructor" ) {
+        ThrowingCopy::copiesLeft = 5;
+        REQUIRE_THROWS( ThrowingHeap( values.begin(), values.end() ) );
+    }
+
+    ThrowingCopy::copiesLeft = std::numeric_limits< int >::max();
+    REQUIRE( ThrowingCopy::live == 20 );
+}
+
+struct Graph
+{
+    std::vector< size_t > mOffsets;
+    std::vector< std::pair< std::uint32_t, std::uint32_t > > mEdges; // target, weight
+};
+
+Graph randomGraph( std::uint32_t vertices, size_t edges ) {
+    std::mt19937 randgen;
+    std::vector< std::pair< std::uint32_t, std::pair< std::uint32_t, std::uint32_t > > > list;
+
+    for ( size_t i = 0; i < edges; ++i ) {
+        std::uint32_t from = randgen() % vertices;
+        std::uint32_t to = randgen() % vertices;
+        list.push_back( { from, { to, static_cast< std::uint32_t >( randgen() % 1000 + 1 ) } } );
+    }
+    std::sort( list.begin(), list.end() );
+
+    Graph g;
+    g.mOffsets.assign( vertices + 1, 0 );
+    for ( auto &e : list ) {
+        ++g.mOffsets[ e.first + 1 ];
+        g.mEdges.push_back( e.second );
+    }
+    for ( std::uint32_t v = 0; v < vertices; ++v )
+        g.mOffsets[ v + 1 ] += g.mOffsets[ v ];
+
+    return g;
+}
+
+// Dijkstra from vertex 0 using decrease-key (promote) on the given heap type.
+template< typename HeapType >
+std::vector< std::uint64_t > dijkstra( const Graph &g ) {
+    const std::uint64_t infinity = std::numeric_limits< std::uint64_t >::max();
+    size_t vertices = g.mOffsets.size() - 1;
+    std::vector< std::uint64_t > dist( vertices, infinity );
+    std::vector< typename HeapType::Handle > handles( vertices );
+    HeapType heap;
+
+    dist[ 0 ] = 0;
+    handles[ 0 ] = heap.insert( { 0, 0 } );
+
+    while ( !heap.empty() ) {
+        std::uint32_t v = heap.top().second;
+        heap.pop();
+
+        for ( size_t e = g.mOffsets[ v ]; e < g.mOffsets[ v + 1 ]; ++e ) {
+            std::uint32_t u = g.mEdges[ e ].first;
+            std::uint64_t d = dist[ v ] + g.mEdges[ e ].second;
+
+            if ( d >= dist[ u ] )
+                continue;
+
+            if ( dist[ u ] == infinity )
+                handles[ u ] = heap.insert( { d, u } );
+            else
+                heap.promote( handles[ u ], { d, u } );
+            dist[ u ] = d;
+        }
+    }
+
+    return dist;
+}
+
+using DistPair = std::pair< std::uint64_t, std::uint32_t >;
+
+TEST_CASE( "Dijkstra" ) {
+    Graph g = randomGraph( 1000, 10000 );
+
+    auto pairingDist = dijkstra< PairingHeap< DistPair, std::greater< DistPair > > >( g );
+    auto binaryDist = dijkstra< Heap< DistPair, std::greater< DistPair > > >( g );
+    REQUIRE( pairingDist == binaryDist );
+}
+
+template< typename HeapType >
+long long dijkstraTime( const Graph &g, std::vector< std::uint64_t > &dist ) {
+    auto start = std::chrono::steady_clock::now();
+    dist = dijkstra< HeapType >( g );
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast< std::chrono::milliseconds >( end - start ).count();
+}
+
+TEST_CASE( "Dijkstra benchmark", "[.][benchmark]" ) {
+    Graph g = randomGraph( 1000000, 10000000 );
+    std::vector< std::uint64_t > binaryDist, pairingDist;
+
+    auto binaryTime = dijkstraTime< Heap< DistPair, std::greater< DistPair > > >( g, binaryDist );
+    auto quaternaryTime = dijkstraTime< Heap< DistPair, std::greater< DistPair >, 4 > >( g, binaryDist );
+    auto pairingTime = dijkstraTime< PairingHeap< DistPair, std::greater< DistPair > > >( g, pairingDist );
+
+    std::cout << "Dijkstra on 10^6 vertices, 10^7 edges: Heap " << binaryTime << " ms, 4-ary Heap "
+              << quaternaryTime << " ms, PairingHeap " << pairingTime << " ms" << std::endl;
+    REQUIRE( binaryDist == pairingDist );
+}
+
+#endif
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <random>
+#include <cstdint>
+#include "catch.hpp"
+#include "heap.h"
+#include "radixheap.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all RadixHeap functions instantiate at least for uint64_t keys.
+template class RadixHeap< std::uint64_t, int >;
+
+TEST_CASE( "Radix heap basics" ) {
+    RadixHeap< std::uint64_t, std::string > heap;
+
+    REQUIRE( heap.empty() );
+    heap.pop();
+    heap.erase( RadixHeap< std::uint64_t, std::string >::Handle() );
+
+    auto h5 = heap.insert( { 5, "five" } );
+    auto h9 = heap.insert( { 9, "nine" } );
+    auto h1 = heap.insert( { 1, "one" } );
+
+    REQUIRE( heap.size() == 3 );
+    REQUIRE( heap.top().second == "one" );
+    REQUIRE( heap.topHandle() == h1 );
+
+    SECTION( "pop" ) {
+        heap.pop();
+        REQUIRE( heap.top().second == "five" );
+        heap.insert( { 1, "one again" } );
+        REQUIRE( heap.top().second == "one again" );
+        heap.pop();
+        heap.pop();
+        REQUIRE( heap.topHandle() == h9 );
+        REQUIRE_FALSE( heap.contains( h5 ) );
+    }
+    SECTION( "decrease key" ) {
+        heap.update( h9, { 0, "zero" } );
+        REQUIRE( heap.topHandle() == h9 );
+        REQUIRE( heap.get( h5 ).first == 5 );
+        heap.pop();
+        heap.update( h5, { 0, "five" } );
+        REQUIRE( heap.topHandle() == h5 );
+        REQUIRE( heap.top().first == 0 );
+    }
+    SECTION( "erase" ) {
+        heap.erase( h1 );
+        REQUIRE( heap.topHandle() == h5 );
+        REQUIRE( heap.size() == 2 );
+        std::vector< std::pair< std::uint64_t, std::string > > expected = { { 5, "five" }, { 9, "nine" } };
+        REQUIRE( toSortedVector( heap ) == expected );
+    }
+}
+
+TEST_CASE( "Radix heap duplicate keys" ) {
+    using Radix = RadixHeap< std::uint64_t, std::string >;
+    Radix heap;
+    std::vector< std::pair< std::uint64_t, std::string > > expected = { { 5, "A" }, { 5, "B" }, { 9, "C" } };
+
+    for ( const auto &value : expected )
+        heap.insert( value );
+
+    auto sorted = toSortedVector( heap );
+    std::sort( sorted.begin(), sorted.end() );
+    REQUIRE( sorted == expected );
+
+    // pop must remove the element top() and topHandle() reported
+    std::vector< std::pair< std::uint64_t, std::string > > popped;
+    while ( !heap.empty() ) {
+        Radix::Handle h = heap.topHandle();
+        REQUIRE( heap.get( h ) == heap.top() );
+        popped.push_back( heap.top() );
+        heap.pop();
+        REQUIRE_FALSE( heap.contains( h ) );
+    }
+    std::sort( popped.begin(), popped.end() );
+    REQUIRE( popped == expected );
+}
+
+using KeyValue = std::pair< std::uint64_t, int >;
+
+TEST_CASE( "Radix heap event simulation" ) {
+    std::mt19937_64 randgen;
+    RadixHeap< std::uint64_t, int > radix;
+    PriorityQueue< std::uint64_t, int, std::greater< std::uint64_t > > reference;
+    std::vector< std::pair< RadixHeap< std::uint64_t, int >::Handle,
+                            PriorityQueue< std::uint64_t, int, std::greater< std::uint64_t > >::Handle > > handles;
+    std::uint64_t now = 0;
+
+    for ( int i = 0; i < 50000; ++i ) {
+        switch ( randgen() % 5 ) {
+            case 0:
+            case 1: {
+                // events are scheduled in the future, at various scales
+                KeyValue event( now + ( randgen() >> ( randgen() % 64 ) ) % ( 1ull << 40 ), i );
+                handles.emplace_back( radix.insert( event ), reference.insert( event ) );
+                break;
+            }
+            case 2:
+                if ( !reference.empty() ) {
+                    REQUIRE( radix.top().first == reference.top().first );
+                    now = radix.top().first;
+                    radix.pop();
+                    reference.pop();
+                }
+                break;
+            case 3: {
+                if ( handles.empty() )
+                    break;
+                auto &h = handles[ randgen() % handles.size() ];
+                if ( !radix.contains( h.first ) )
+                    break;
+                std::uint64_t key = radix.get( h.first ).first;
+                KeyValue earlier( now + ( key - now ) / 2, -i );
+                radix.update( h.first, earlier );
+                reference.update( h.second, earlier );
+                break;
+            }
+            case 4: {
+                if ( handles.empty() )
+                    break;
+                size_t index = randgen() % handles.size();
+                if ( radix.contains( handles[ index ].first ) ) {
+                    radix.erase( handles[ index ].first );
+                    reference.erase( handles[ index ].second );
+                }
+                handles.erase( handles.begin() + index );
+                break;
+            }
+        }
+
+        REQUIRE( radix.size() == reference.size() );
+    }
+
+    while ( !reference.empty() ) {
+        REQUIRE( radix.top().first == reference.top().first );
+        REQUIRE( radix.get( radix.topHandle() ).first == reference.top().first );
+        radix.pop();
+        reference.pop();
+    }
+    REQUIRE( radix.empty() );
+}
+
+#endif
@@ -0,0 +1,264 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "catch.hpp"
+#include "heap.h"
+#include "splitpriorityqueue.h"
+
+#define ALLOW_TESTS
+//#undef ALLOW_TESTS
+
+#ifdef ALLOW_TESTS
+
+// Test that all SplitPriorityQueue functions instantiate at least for ints.
+template class SplitPriorityQueue< int, int >;
+template class SplitPriorityQueue< int, std::string, std::greater< int >, 4 >;
+
+using SplitQueue = SplitPriorityQueue< int, std::string >;
+
+TEST_CASE( "Split priority queue basics" ) {
+    SplitQueue queue;
+
+    REQUIRE( queue.empty() );
+    queue.pop();
+    queue.erase( SplitQueue::Handle() );
+    REQUIRE_FALSE( queue.contains( SplitQueue::Handle() ) );
+
+    auto five = queue.insert( { 5, "five" } );
+    auto three = queue.insert( { 3, "three" } );
+    auto eight = queue.emplace( 8, 3, 'e' );
+    auto one = queue.insert( { 1, "one" } );
+
+    REQUIRE( queue.size() == 4 );
+    REQUIRE( queue.topHandle() == eight );
+    REQUIRE( queue.top().first == 8 );
+    REQUIRE( queue.top().second == "eee" );
+    REQUIRE( queue.get( three ).second == "three" );
+
+    SECTION( "pop" ) {
+        std::vector< std::pair< int, std::string > > expected = {
+            { 8, "eee" }, { 5, "five" }, { 3, "three" }, { 1, "one" } };
+        REQUIRE( toSortedVector( queue ) == expected );
+        REQUIRE( queue.size() == 4 );
+        REQUIRE( queue.topHandle() == eight );
+
+        queue.pop();
+        REQUIRE_FALSE( queue.contains( eight ) );
+        REQUIRE( queue.extractTop() == std::make_pair( 5, std::string( "five" ) ) );
+        REQUIRE_FALSE( queue.contains( five ) );
+        REQUIRE( queue.size() == 2 );
+    }
+    SECTION( "update" ) {
+        queue.update( one, { 9, "nine" } );
+        REQUIRE( queue.topHandle() == one );
+        REQUIRE( queue.get( one ).second == "nine" );
+
+        queue.updatePriority( eight, 0 );
+        queue.getValue( eight ) = "zero";
+        REQUIRE( queue.get( eight ).first == 0 );
+
+        std::vector< std::pair< int, std::string > > expected = {
+            { 9, "nine" }, { 5, "five" }, { 3, "three" }, { 0, "zero" } };
+        REQUIRE( toSortedVector( queue ) == expected );
+    }
+    SECTION( "erase" ) {
+        queue.erase( eight );
+        queue.erase( three );
+        REQUIRE_FALSE( queue.contains( three ) );
+        REQUIRE( queue.topHandle() == five );
+        REQUIRE( queue.size() == 2 );
+
+        // the freed slots are reused with new generations
+        auto again = queue.insert( { 4, "four" } );
+        REQUIRE( again != three );
+        REQUIRE( queue.get( again ).second == "four" );
+    }
+    SECTION( "copy, move and swap" ) {
+        SplitQueue copy( queue );
+        copy.pop();
+        REQUIRE( queue.size() == 4 );
+        REQUIRE( copy.topHandle() == five );
+
+        SplitQueue moved = std::move( queue );
+        SplitQueue other;
+        swap( moved, other );
+        REQUIRE( other.topHandle() == eight );
+        REQUIRE( other.get( one ).second == "one" );
+        REQUIRE( moved.empty() );
+
+        other = copy;
+        REQUIRE( other.size() == 3 );
+        REQUIRE( other.top().second == "five" );
+    }
+}
+
+TEST_CASE( "Split priority queue against PriorityQueue" ) {
+    std::mt19937 randgen;
+    SplitPriorityQueue< int, int, std::greater< int >, 4 > split;
+    PriorityQueue< int, int, std::greater< int > > reference;
+    std::vector< std::pair< decltype( split )::Handle, PriorityQueue< int, int, std::greater< int > >::Handle > > handles;
+
+    for ( int i = 0; i < 20000; ++i ) {
+        int priority = static_cast< int >( randgen() % 1000 );
+
+        switch ( randgen() % 4 ) {
+            case 0:
+            case 1: {
+                // the value is the index of the element's handles
+                int value = static_cast< int >( handles.size() );
+                handles.emplace_back( split.insert( { priority, value } ), reference.insert( { priority, value } ) );
+                break;
+            }
+            case 2:
+                REQUIRE( split.empty() == reference.empty() );
+                if ( !reference.empty() ) {
+                    REQUIRE( split.top().first == reference.top().first );
+                    // equal priorities may be ordered differently, so the
+                    // popped element is erased from the reference by value
+                    int value = split.top().second;
+                    REQUIRE( reference.contains( handles[ value ].second ) );
+                    reference.erase( handles[ value ].second );
+                    split.pop();
+                }
+                break;
+            case 3: {
+                if ( handles.empty() )
+                    break;
+                size_t index = randgen() % handles.size();
+                auto &h = handles[ index ];
+                REQUIRE( split.contains( h.first ) == reference.contains( h.second ) );
+                if ( !reference.contains( h.second ) )
+                    break;
+                REQUIRE( split.get( h.first ).first == reference.get( h.second ).first );
+                if ( i % 2 ) {
+                    split.updatePriority( h.first, priority );
+                    reference.update( h.second, { priority, static_cast< int >( index ) } );
+                } else {
+                    split.erase( h.first );
+                    reference.erase( h.second );
+                }
+                break;
+            }
+        }
+
+        REQUIRE( split.size() == reference.size() );
+    }
+
+    std::vector< int > splitPriorities, referencePriorities;
+    for ( auto &element : toSortedVector( split ) )
+        splitPriorities.push_back( element.first );
+    for ( auto &element : toSortedVector( reference ) )
+        referencePriorities.push_back( element.first );
+    REQUIRE( splitPriorities == referencePriorities );
+}
+
+// Counts the live instances, so leaks and double destruction show up.
+struct Tracked {
+    static int sLive;
+    int mX;
+
+    Tracked( int x ) : mX( x ) { ++sLive; }
+    Tracked( const Tracked &o ) : mX( o.mX ) { ++sLive; }
+    Tracked &operator=( const Tracked & ) = default;
+    ~Tracked() { --sLive; }
+};
+
+int Tracked::sLive = 0;
+
+TEST_CASE( "Split priority queue values" ) {
+    SECTION( "values are destroyed exactly once" ) {
+        {
+            SplitPriorityQueue< int, Tracked > queue;
+            std::vector< SplitPriorityQueue< int, Tracked >::Handle > handles;
+            for ( int i = 0; i < 1000; ++i )
+                handles.push_back( queue.emplace( i * 7 % 1000, i ) );
+            for ( int i = 0; i < 1000; i += 3 )
+                queue.erase( handles[ i ] );
+            for ( int i = 0; i < 100; ++i )
+                queue.pop();
+            REQUIRE( Tracked::sLive == static_cast< int >( queue.size() ) );
+
+            SplitPriorityQueue< int, Tracked > copy( queue );
+            REQUIRE( Tracked::sLive == static_cast< int >( 2 * queue.size() ) );
+            REQUIRE( copy.get( handles[ 500 ] ).second.mX == 500 );
+
+            auto sorted = toSortedVector( std::move( copy ) );
+            REQUIRE( sorted.size() == queue.size() );
+            REQUIRE( Tracked::sLive == static_cast< int >( 2 * queue.size() ) );
+            REQUIRE( copy.empty() );
+            REQUIRE_FALSE( copy.contains( handles[ 500 ] ) );
+        }
+        REQUIRE( Tracked::sLive == 0 );
+    }
+    SECTION( "values are never moved" ) {
+        using Value = std::unique_ptr< int >;
+        SplitPriorityQueue< int, Value > queue;
+        std::vector< std::pair< SplitPriorityQueue< int, Value >::Handle, const Value * > > handles;
+
+        for ( int i = 0; i < 2000; ++i ) {
+            auto h = queue.emplace( i * 7919 % 2003, new int( i ) );
+            handles.emplace_back( h, &queue.get( h ).second );
+        }
+        for ( int i = 0; i < 2000; i += 2 )
+            queue.updatePriority( handles[ i ].first, -i );
+        for ( int i = 0; i < 500; ++i )
+            queue.pop();
+
+        for ( auto &h : handles ) {
+            if ( queue.contains( h.first ) )
+                REQUIRE( &queue.get( h.first ).second == h.second );
+        }
+
+        auto top = queue.extractTop();
+        REQUIRE( *top.second >= 0 );
+    }
+}
+
+// A large value, which PriorityQueue moves along with its priority.
+struct Payload256 {
+    std::uint64_t mData[ 32 ];
+
+    explicit Payload256( std::uint64_t x = 0 ) {
+        std::fill( mData, mData + 32, x );
+    }
+};
+
+// Milliseconds of a Dijkstra-like workload: a queue of n elements where each
+// step pops the top and inserts an element with a larger priority.
+template< typename Queue >
+long long popInsertTime( int n, int steps ) {
+    Queue queue;
+    std::mt19937 randgen;
+    for ( int i = 0; i < n; ++i )
+        queue.insert( { static_cast< std::uint32_t >( randgen() % 1000000 ), Payload256( i ) } );
+
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < steps; ++i ) {
+        std::uint32_t priority = queue.top().first;
+        queue.pop();
+        queue.insert( { priority + static_cast< std::uint32_t >( randgen() % 1000 ), Payload256( i ) } );
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast< std::chrono::milliseconds >( end - start ).count();
+}
+
+TEST_CASE( "Split priority queue benchmark", "[.][benchmark]" ) {
+    using Cmp = std::greater< std::uint32_t >;
+
+    for ( int n : { 1000, 100000, 1000000 } ) {
+        std::cout << n << " elements with 256 B values: PriorityQueue "
+                  << popInsertTime< PriorityQueue< std::uint32_t, Payload256, Cmp > >( n, 1000000 )
+                  << " ms, SplitPriorityQueue "
+                  << popInsertTime< SplitPriorityQueue< std::uint32_t, Payload256, Cmp > >( n, 1000000 )
+                  << " ms" << std::endl;
+    }
+}
+
+#endif